@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Little endian integers for the file formats (snapshots, captures, ROM index).
+namespace ByteIO {
+	inline void Put(std::vector<uint8_t>& out, uint64_t value, int bytes)
+	{
+		for (int i = 0; i < bytes; i++) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+	}
+
+	inline uint64_t Get(const uint8_t* in, int bytes)
+	{
+		uint64_t value = 0;
+		for (int i = 0; i < bytes; i++) value |= static_cast<uint64_t>(in[i]) << (8 * i);
+		return value;
+	}
+
+	// bounds checked read that advances pos, false if it would run past the end
+	inline bool Read(const std::vector<uint8_t>& in, size_t& pos, uint64_t& value, int bytes)
+	{
+		if (pos + bytes > in.size()) return false;
+		value = Get(in.data() + pos, bytes);
+		pos += bytes;
+		return true;
+	}
+}
@@ -1,53 +1,61 @@
 #include "Chip8.h"
+#include "Debugger.h"
+#include "VipTiming.h"
+#include "ByteIO.h"
 
 #include <fstream>
 #include <iostream>
 #include <cstring>
+#include <sstream>
 #include <vector>
 #include <random>
 #include <ctime>
+#include <algorithm>
+
+namespace {
+
+const uint8_t hexSpritesBuffer[80] = {
+	// 0
+	0xF0, 0x90, 0x90, 0x90, 0xF0,
+	// 1
+	0x20, 0x60, 0x20, 0x20, 0x70,
+	// 2
+	0xF0, 0x10, 0xF0, 0x80, 0xF0,
+	// 3
+	0xF0, 0x10, 0xF0, 0x10, 0xF0,
+	// 4
+	0x90, 0x90, 0xF0, 0x10, 0x10,
+	// 5
+	0xF0, 0x80, 0xF0, 0x10, 0xF0,
+	// 6
+	0xF0, 0x80, 0xF0, 0x90, 0xF0,
+	// 7
+	0xF0, 0x10, 0x20, 0x40, 0x40,
+	// 8
+	0xF0, 0x90, 0xF0, 0x90, 0xF0,
+	// 9
+	0xF0, 0x90, 0xF0, 0x10, 0xF0,
+	// A
+	0xF0, 0x90, 0xF0, 0x90, 0x90,
+	// B
+	0xE0, 0x90, 0xE0, 0x90, 0xE0,
+	// C
+	0xF0, 0x80, 0x80, 0x80, 0xF0,
+	// D
+	0xE0, 0x90, 0x90, 0x90, 0xE0,
+	// E
+	0xF0, 0x80, 0xF0, 0x80, 0xF0,
+	// F
+	0xF0, 0x80, 0xF0, 0x80, 0x80
+};
+
+}
 
 Chip8::Chip8()
 {
 	// normally you would load the font here, TODO
-	srand(time(0)); // for RND
 	pc = 0x200; // set the program counter back to initial position in memory
 
-	uint8_t hexSpritesBuffer[80] = {
-		// 0
-		0xF0, 0x90, 0x90, 0x90, 0xF0,
-		// 1
-		0x20, 0x60, 0x20, 0x20, 0x70,
-		// 2
-		0xF0, 0x10, 0xF0, 0x80, 0xF0,
-		// 3
-		0xF0, 0x10, 0xF0, 0x10, 0xF0,
-		// 4
-		0x90, 0x90, 0xF0, 0x10, 0x10,
-		// 5
-		0xF0, 0x80, 0xF0, 0x10, 0xF0,
-		// 6
-		0xF0, 0x80, 0xF0, 0x90, 0xF0,
-		// 7
-		0xF0, 0x10, 0x20, 0x40, 0x40,
-		// 8
-		0xF0, 0x90, 0xF0, 0x90, 0xF0,
-		// 9
-		0xF0, 0x90, 0xF0, 0x10, 0xF0,
-		// A
-		0xF0, 0x90, 0xF0, 0x90, 0x90,
-		// B
-		0xE0, 0x90, 0xE0, 0x90, 0xE0,
-		// C
-		0xF0, 0x80, 0x80, 0x80, 0xF0,
-		// D
-		0xE0, 0x90, 0x90, 0x90, 0xE0,
-		// E
-		0xF0, 0x80, 0xF0, 0x80, 0xF0,
-		// F
-		0xF0, 0x80, 0xF0, 0x80, 0x80
-	};
-
 	// load hex sprites into memory during init
 	memcpy(&memory[0x50], hexSpritesBuffer, sizeof(hexSpritesBuffer));
 
@@ -64,26 +72,213 @@ void Chip8::LoadROM(const std::string& filename)
 	// copy the input file stream into a vector as a buffer
 	std::vector<uint8_t> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
 
-	//TODO: check that ROM fits into memory
+	if (buffer.size() > MAX_ROM_SIZE) {
+		std::cerr << "ROM too big to fit in memory: " << filename << " (" << buffer.size() << " bytes)\n";
+		return;
+	}
+
+	LoadROM(buffer);
+}
 
+void Chip8::LoadROM(const std::vector<uint8_t>& rom)
+{
 	//copy the memory location of the buffer to the memory location of "memory" with the 0x200 offset as the start of the program
-	std::copy(buffer.begin(), buffer.end(), memory + 0x200);
+	std::copy(rom.begin(), rom.begin() + std::min(rom.size(), MAX_ROM_SIZE), memory + 0x200);
+	dirtyPages = 0;
+}
+
+namespace {
+
+// layout of SaveState: V, I, pc, stack, sp, timers, cycleBudget, rng, dirtyPages, packed display,
+// memory length, memory, then the dirty pages below 0x200
+const size_t STATE_HEADER_SIZE = 16 + 2 + 2 + 32 + 3 + 4 + 4 + 8 + 256 + 2;
+
+}
+
+std::vector<uint8_t> Chip8::SaveState() const
+{
+	size_t memoryEnd = sizeof(memory);
+	while (memoryEnd > 0x200 && memory[memoryEnd - 1] == 0) --memoryEnd;
+
+	std::vector<uint8_t> state;
+	state.reserve(STATE_HEADER_SIZE + memoryEnd - 0x200);
+	state.insert(state.end(), V, V + sizeof(V));
+	ByteIO::Put(state, I, 2);
+	ByteIO::Put(state, pc, 2);
+	for (uint16_t address : stack) ByteIO::Put(state, address, 2);
+	ByteIO::Put(state, sp, 1);
+	ByteIO::Put(state, delayTimer, 1);
+	ByteIO::Put(state, soundTimer, 1);
+	ByteIO::Put(state, static_cast<uint32_t>(cycleBudget), 4);
+	ByteIO::Put(state, rng, 4);
+	ByteIO::Put(state, dirtyPages, 8);
+
+	// 1 bit per pixel, leftmost pixel in the high bit
+	for (size_t i = 0; i < sizeof(display); i += 8) {
+		uint8_t packed = 0;
+		for (int bit = 0; bit < 8; bit++) packed |= (display[i + bit] & 1) << (7 - bit);
+		state.push_back(packed);
+	}
+
+	ByteIO::Put(state, memoryEnd - 0x200, 2);
+	state.insert(state.end(), memory + 0x200, memory + memoryEnd);
+
+	// the interpreter area is the font everywhere else, FX33/FX55 below 0x200 is rare
+	for (int page = 0; page < 8; page++) {
+		if ((dirtyPages >> page) & 1) state.insert(state.end(), memory + page * 64, memory + page * 64 + 64);
+	}
+	return state;
+}
+
+bool Chip8::LoadState(const std::vector<uint8_t>& state)
+{
+	if (state.size() < STATE_HEADER_SIZE) return false;
+
+	const uint8_t* in = state.data();
+	uint64_t savedPages = ByteIO::Get(in + STATE_HEADER_SIZE - 2 - 256 - 8, 8);
+	size_t memoryLength = ByteIO::Get(in + STATE_HEADER_SIZE - 2, 2);
+	size_t lowLength = 0;
+	for (int page = 0; page < 8; page++) {
+		if ((savedPages >> page) & 1) lowLength += 64;
+	}
+	if (memoryLength > MAX_ROM_SIZE || state.size() != STATE_HEADER_SIZE + memoryLength + lowLength) return false;
+	// CALL never pushes past 15 entries
+	if (in[sizeof(V) + 4 + sizeof(stack)] > 15) return false;
+
+	std::copy(in, in + sizeof(V), V);
+	in += sizeof(V);
+	I = static_cast<uint16_t>(ByteIO::Get(in, 2));
+	pc = static_cast<uint16_t>(ByteIO::Get(in + 2, 2));
+	in += 4;
+	for (uint16_t& address : stack) {
+		address = static_cast<uint16_t>(ByteIO::Get(in, 2));
+		in += 2;
+	}
+	sp = in[0];
+	delayTimer = in[1];
+	soundTimer = in[2];
+	cycleBudget = static_cast<int32_t>(ByteIO::Get(in + 3, 4));
+	Seed(static_cast<uint32_t>(ByteIO::Get(in + 7, 4)));
+	dirtyPages = savedPages;
+	in += 3 + 4 + 4 + 8;
+
+	for (size_t i = 0; i < sizeof(display); i++) {
+		display[i] = (in[i / 8] >> (7 - i % 8)) & 1;
+	}
+	in += sizeof(display) / 8 + 2;
+
+	std::memset(memory + 0x200, 0, MAX_ROM_SIZE);
+	std::copy(in, in + memoryLength, memory + 0x200);
+	in += memoryLength;
+
+	std::memset(memory, 0, 0x200);
+	memcpy(&memory[0x50], hexSpritesBuffer, sizeof(hexSpritesBuffer));
+	for (int page = 0; page < 8; page++) {
+		if (!((savedPages >> page) & 1)) continue;
+		std::copy(in, in + 64, memory + page * 64);
+		in += 64;
+	}
+
+	std::memset(keypad, 0, sizeof(keypad));
+	frameInterrupted = false;
+	drawFlag = true; // whatever was restored needs to be shown
+	return true;
+}
+
+void Chip8::MarkDirty(uint16_t addr, uint16_t length)
+{
+	// same wrap at 4K as the writes themselves
+	addr &= 0x0FFF;
+	uint16_t last = (addr + length - 1) / 64;
+	for (uint16_t page = addr / 64; page <= last; page++) {
+		dirtyPages |= 1ULL << (page % 64);
+	}
+}
+
+uint16_t Chip8::FetchOpcode() const
+{
+	// BNNN and running off the end can leave pc past 0xFFF, wrap like ReadMemory
+	return (memory[pc & 0x0FFF] << 8) | memory[(pc + 1) & 0x0FFF];
+}
+
+void Chip8::Fault(const char* message, uint16_t opcode)
+{
+	// built as one string so cores on several threads don't share stream flags
+	std::ostringstream line;
+	line << message << ": " << std::hex << opcode << " at 0x" << (pc - 2) << "\n";
+	std::cerr << line.str();
+	if (debugger) debugger->OnFault(line.str());
 }
 
 void Chip8::Cycle()
 {
+	if (!Step()) return;
+
+	TickTimers();
+}
+
+void Chip8::RunFrame()
+{
+	// a frame the debugger stopped halfway through carries on where it was,
+	// so breaking never hands the ROM extra cycles
+	if (!frameInterrupted) cycleBudget += VipTiming::CYCLES_PER_FRAME;
+	frameInterrupted = false;
+
+	while (cycleBudget > 0) {
+		uint16_t opcode = FetchOpcode();
+
+		if ((opcode & 0xF000) == 0xD000) {
+			// the VIP waits for the vertical blank interrupt before drawing,
+			// so whatever is left of this frame is lost and the draw itself
+			// eats into the next one
+			uint16_t cost = VipTiming::DrawCost(opcode, V[(opcode & 0x0F00) >> 8], V[(opcode & 0x00F0) >> 4]);
+			if (!Step()) {
+				frameInterrupted = true;
+				return;
+			}
+			cycleBudget = -cost;
+			break;
+		}
+
+		if (!Step()) {
+			frameInterrupted = true;
+			return;
+		}
+		cycleBudget -= VipTiming::Cost(opcode);
+	}
+
+	TickTimers();
+}
+
+bool Chip8::Step()
+{
+	// only costs a pointer test when no debugger is attached
+	if (debugger && debugger->OnFetch(pc)) return false;
+
 	// grabs first byte in memory array with program counter variable
 	// bit shifts it 8 bits to the left since chip8 instructions are 16-bit
 	// grab second byte in memory array, the value for the instruction
 	// uses "or" | operator to join them together like so:
 	// XXXX0000 + 0000XXXX
-	uint16_t opcode = (memory[pc] << 8) | memory[pc + 1];
+	uint16_t opcode = FetchOpcode();
 	// increment the program counter by 2
 	// since each instruction is made out of 2 bytes
 	pc += 2;
 	// self explanatory lol
 	ExecuteOpcode(opcode);
+	return true;
+}
 
+uint8_t Chip8::NextRandom()
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return static_cast<uint8_t>(rng >> 24);
+}
+
+void Chip8::TickTimers()
+{
 	//Decrement timers
 	if (delayTimer > 0) --delayTimer;
 	if (soundTimer > 0) --soundTimer;
@@ -98,15 +293,19 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 		switch (opcode & 0x00ff) {
 		case 0x00E0:
 			std::memset(display, 0, sizeof(display));
-			std::cout << "Screen cleared\n";
+			if (trace) *trace << "Screen cleared\n";
 			break;
 		case 0x00EE:
+			if (sp == 0) {
+				Fault("[00EE] ERROR: STACK UNDERFLOW!", opcode);
+				break;
+			}
 			--sp;
 			pc = stack[sp];
-			std::cout << "Returning from subroutine\n";
+			if (trace) *trace << "Returning from subroutine\n";
 			break;
 		default:
-			std::cerr << "Unknown 0x0 opcode: " << std::hex << opcode << "\n";
+			Fault("Unknown 0x0 opcode", opcode);
 			break;
 		}
 		break;
@@ -117,7 +316,7 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 	case 0x1000: {
 		uint16_t NNN = opcode & 0x0FFF;
 		pc = NNN;
-		std::cout << "[1NNN] Jump to " << std::hex << NNN << std::dec << "\n";
+		if (trace) *trace << "[1NNN] Jump to " << std::hex << NNN << std::dec << "\n";
 		break;
 	}
 	
@@ -129,7 +328,7 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 	case 0x2000: {
 		uint16_t NNN = opcode & 0x0FFF;
 		if (sp >= 15) {
-			std::cerr << "[2NNN] ERROR: STACK OVERFLOW!";
+			Fault("[2NNN] ERROR: STACK OVERFLOW!", opcode);
 			break;
 		}
 		//sp++;
@@ -149,11 +348,11 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 
 		if (V[X] == KK) {
 			pc += 2;
-			std::cout << "[3XKK] V[" << X << "] == " << KK << " - skipping instruction" << "\n";
+			if (trace) *trace << "[3XKK] V[" << X << "] == " << KK << " - skipping instruction" << "\n";
 			break;
 		}
 		
-		std::cout << "[3XKK] V[" << X << "] != " << KK << " - continuing" << "\n";
+		if (trace) *trace << "[3XKK] V[" << X << "] != " << KK << " - continuing" << "\n";
 		break;
 	}
 
@@ -167,11 +366,11 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 
 		if (V[X] != KK) {
 			pc += 2;
-			std::cout << "[4XKK] V[" << X << "] != " << KK << " - skipping instruction" << "\n";
+			if (trace) *trace << "[4XKK] V[" << X << "] != " << KK << " - skipping instruction" << "\n";
 			break;
 		}
 
-		std::cout << "[4XKK] V[" << X << "] == " << KK << " - continuing" << "\n";
+		if (trace) *trace << "[4XKK] V[" << X << "] == " << KK << " - continuing" << "\n";
 		break;
 	}
 
@@ -185,11 +384,11 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 
 		if (V[X] == V[Y]) {
 			pc += 2;
-			std::cout << "[5XY0] V[" << (int)X << "] == V[" << (int)Y << "] - skipping instruction" << "\n";
+			if (trace) *trace << "[5XY0] V[" << (int)X << "] == V[" << (int)Y << "] - skipping instruction" << "\n";
 			break;
 		}
 
-		std::cout << "[5XY0] V[" << (int)X << "] != V[" << (int)Y << "] - continuing" << "\n";
+		if (trace) *trace << "[5XY0] V[" << (int)X << "] != V[" << (int)Y << "] - continuing" << "\n";
 		break;
 	}
 
@@ -200,7 +399,7 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 		uint8_t X = (opcode & 0x0F00) >> 8;
 		uint8_t NN = opcode & 0x00FF;
 		V[X] = NN;
-		std::cout << "Set V[" << (int)X << "] = " << (int)NN << "\n";
+		if (trace) *trace << "Set V[" << (int)X << "] = " << (int)NN << "\n";
 		break;
 	}
 
@@ -211,7 +410,7 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 		uint8_t X = (opcode & 0x0F00) >> 8;
 		uint8_t NN = opcode & 0x00FF;
 		V[X] += NN;
-		std::cout << "Add " << (int)NN << " to V[" << (int)X << "]\n";
+		if (trace) *trace << "Add " << (int)NN << " to V[" << (int)X << "]\n";
 		break;
 	}
 	
@@ -225,7 +424,7 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 			uint8_t X = (opcode & 0x0F00) >> 8;
 			uint8_t Y = (opcode & 0x00F0) >> 4;
 			V[X] = V[Y];
-			std::cout << "Set V[" << (int)X << "] = " << "V[" << (int)Y << "]\n";
+			if (trace) *trace << "Set V[" << (int)X << "] = " << "V[" << (int)Y << "]\n";
 			break;
 		}
 
@@ -238,7 +437,7 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 			uint8_t X = (opcode & 0x0F00) >> 8;
 			uint8_t Y = (opcode & 0x00F0) >> 4;
 			V[X] = (V[X] | V[Y]);
-			std::cout << "V[" << (int)X << "] = " << "V[" << (int)X << "] OR " << "V[" << (int)Y << "]\n";
+			if (trace) *trace << "V[" << (int)X << "] = " << "V[" << (int)X << "] OR " << "V[" << (int)Y << "]\n";
 			break;
 		}
 
@@ -251,7 +450,7 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 			uint8_t X = (opcode & 0x0F00) >> 8;
 			uint8_t Y = (opcode & 0x00F0) >> 4;
 			V[X] = (V[X] & V[Y]);
-			std::cout << "V[" << (int)X << "] = " << "V[" << (int)X << "] AND " << "V[" << (int)Y << "]\n";
+			if (trace) *trace << "V[" << (int)X << "] = " << "V[" << (int)X << "] AND " << "V[" << (int)Y << "]\n";
 			break;
 		}
 
@@ -264,7 +463,7 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 			uint8_t X = (opcode & 0x0F00) >> 8;
 			uint8_t Y = (opcode & 0x00F0) >> 4;
 			V[X] = (V[X] ^ V[Y]);
-			std::cout << "V[" << (int)X << "] = " << "V[" << (int)X << "] XOR " << "V[" << (int)Y << "]\n";
+			if (trace) *trace << "V[" << (int)X << "] = " << "V[" << (int)X << "] XOR " << "V[" << (int)Y << "]\n";
 			break;
 		}
 
@@ -281,12 +480,12 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 			if (SUM > 255) {
 				V[X] = SUM & 0x00FF; // store the lowest 8 bits (0xFF = 0b11111111)
 				V[0xF] = 0x1;
-				std::cout << "8xy4 V[" << (int)X << "] = " << "V[" << (int)X << "] + " << "V[" << (int)Y << "]" << ", V[F] = 0x1 (Carry)" << "\n";
+				if (trace) *trace << "8xy4 V[" << (int)X << "] = " << "V[" << (int)X << "] + " << "V[" << (int)Y << "]" << ", V[F] = 0x1 (Carry)" << "\n";
 			}
 			else {
 				V[X] = SUM & 0x00FF; // store the lowest 8 bits as well since registers are 8-bit
 				V[0xF] = 0x0;
-				std::cout << "8xy4 V[" << (int)X << "] = " << "V[" << (int)X << "] + " << "V[" << (int)Y << "]" << ", V[F] = 0x0 (Carry)" << "\n";
+				if (trace) *trace << "8xy4 V[" << (int)X << "] = " << "V[" << (int)X << "] + " << "V[" << (int)Y << "]" << ", V[F] = 0x0 (Carry)" << "\n";
 			}
 			break;
 		}
@@ -306,7 +505,7 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 				V[0xF] = 0;
 				V[X] -= V[Y];
 			}
-			std::cout << "8xy5: V[" << (int)X << "] = " << "V[" << (int)X << "] - " << "V[" << (int)Y << "]\n";
+			if (trace) *trace << "8xy5: V[" << (int)X << "] = " << "V[" << (int)X << "] - " << "V[" << (int)Y << "]\n";
 			break;
 		}
 
@@ -326,7 +525,7 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 				V[0xF] = 0;
 			}
 			V[X] = V[X] >> 1;
-			std::cout << "V[" << (int)X << "] = " << "V[" << (int)X << "] SHR " << "1\n";
+			if (trace) *trace << "V[" << (int)X << "] = " << "V[" << (int)X << "] SHR " << "1\n";
 			break;
 		}
 
@@ -339,7 +538,7 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 			uint8_t Y = (opcode & 0x00F0) >> 4;
 			V[0xF] = V[Y] > V[X] ? 1 : 0;
 			V[X] = V[Y] - V[X];
-			std::cout << "V[" << (int)X << "] = " << "V[" << (int)Y << "] - [" << (int)X << "]\n";
+			if (trace) *trace << "V[" << (int)X << "] = " << "V[" << (int)Y << "] - [" << (int)X << "]\n";
 			break;
 		}
 
@@ -353,12 +552,12 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 			uint8_t Y = (opcode & 0x00F0) >> 4;
 			V[0xF] = (V[X] & 0b10000000) ? 1 : 0;
 			V[X] = V[X] << 1;
-			std::cout << "V[" << (int)X << "] = " << "V[" << (int)X << "] SHL " << "1\n";
+			if (trace) *trace << "V[" << (int)X << "] = " << "V[" << (int)X << "] SHL " << "1\n";
 			break;
 		}
 
 		default:
-			std::cerr << "Unknown 0x8 opcode: " << std::hex << opcode << "\n";
+			Fault("Unknown 0x8 opcode", opcode);
 			break;
 	}
 		break;
@@ -373,11 +572,11 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 
 		if (V[X] != V[Y]) {
 			pc += 2;
-			std::cout << "[9XY0] V[" << (int)X << "] != V[" << (int)Y << "] - skipping instruction" << "\n";
+			if (trace) *trace << "[9XY0] V[" << (int)X << "] != V[" << (int)Y << "] - skipping instruction" << "\n";
 			break;
 		}
 
-		std::cout << "[9XY0] V[" << (int)X << "] == V[" << (int)Y << "] - continuing" << "\n";
+		if (trace) *trace << "[9XY0] V[" << (int)X << "] == V[" << (int)Y << "] - continuing" << "\n";
 		break;
 	}
 
@@ -388,7 +587,7 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 		uint16_t NNN = opcode & 0x0FFF;
 		I = NNN;
 
-		std::cout << "[ANNN] I = " << (int)NNN << "\n";
+		if (trace) *trace << "[ANNN] I = " << (int)NNN << "\n";
 		break;
 	}
 
@@ -398,7 +597,7 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 	case 0xB000: {
 		uint16_t NNN = opcode & 0x0FFF;
 		pc = V[0x0] + NNN;
-		std::cout << "[BNNN] Jump to " << std::hex << (int)pc << std::dec << "\n";
+		if (trace) *trace << "[BNNN] Jump to " << std::hex << (int)pc << std::dec << "\n";
 		break;
 	}
 
@@ -407,11 +606,11 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 	The interpreter generates a random number from 0 to 255, which is then ANDed with the value kk.
 	The results are stored in Vx. See instruction 8xy2 for more information on AND.*/
 	case 0xC000: {
-		uint8_t RND = rand() % 256;
+		uint8_t RND = NextRandom();
 		uint8_t X = (opcode & 0x0F00) >> 8;
 		uint16_t KK = opcode & 0x00FF;
 		V[X] = RND & KK;
-		std::cout << "[CXKK] V[" << (int)X << "] = RND(" << RND << ") AND " << KK << "\n";
+		if (trace) *trace << "[CXKK] V[" << (int)X << "] = RND(" << RND << ") AND " << KK << "\n";
 		break;
 	}
 
@@ -434,6 +633,8 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 		bool collision = false;
 		V[0xF] = 0; // reset collision
 
+		if (debugger) debugger->OnMemoryAccess(I, N, Debugger::WATCH_READ);
+
 		for (int row = 0; row < N; row++) {
 
 			uint16_t y = ((yPos + row) % 32) * 64;
@@ -442,7 +643,7 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 
 				uint8_t x = (xPos + col) % 64;
 
-				uint8_t spriteStripe = memory[I + row];
+				uint8_t spriteStripe = memory[(I + row) & 0x0FFF];
 				uint8_t bit = (spriteStripe >> (7 - col)) & 0x1;
 
 				if (display[x + y] != 0 && bit != 0) collision = true;
@@ -464,9 +665,10 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 			is currently in the down position, PC is increased by 2.*/
 			case 0x009E: {
 				uint8_t X = (opcode & 0x0F00) >> 8;
-				if (keypad[V[X]]) {
+				keyPolled = true;
+				if (keypad[V[X] & 0xF]) {
 					pc += 2;
-					std::cout << "[EX9E] Key " << (int)V[X] << " is pressed - skipping instruction" << "\n";
+					if (trace) *trace << "[EX9E] Key " << (int)V[X] << " is pressed - skipping instruction" << "\n";
 				}
 				break;
 			}
@@ -476,15 +678,16 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 			is currently in the up position, PC is increased by 2.*/
 			case 0x00A1: {
 				uint8_t X = (opcode & 0x0F00) >> 8;
-				if (!keypad[V[X]]) {
+				keyPolled = true;
+				if (!keypad[V[X] & 0xF]) {
 					pc += 2;
-					std::cout << "[EXA1] Key " << (int)V[X] << " is not pressed - skipping instruction" << "\n";
+					if (trace) *trace << "[EXA1] Key " << (int)V[X] << " is not pressed - skipping instruction" << "\n";
 				}
 				break;
 			}
 
 			default:
-				std::cerr << "Unknown 0xF opcode: " << std::hex << opcode << "\n";
+				Fault("Unknown 0xF opcode", opcode);
 				break;
 		}
 		break;
@@ -505,16 +708,18 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 		All execution stops until a key is pressed, then the value of that key is stored in Vx.*/
 		case 0x000A: {
 			uint8_t X = (opcode & 0x0F00) >> 8;
+			keyPolled = true;
 			bool pressed = false;
-			while (!pressed) {
-				for (int i = 0; i < 16; i++) {
-					if (keypad[i]) {
-						V[X] = i;
-						pressed = true;
-						break;
-					}
+			for (int i = 0; i < 16; i++) {
+				if (keypad[i]) {
+					V[X] = i;
+					pressed = true;
+					break;
 				}
 			}
+			// run this instruction again next cycle instead of spinning here,
+			// nothing can press a key while we block the thread
+			if (!pressed) pc -= 2;
 			break;
 		}
 
@@ -554,7 +759,7 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 		case 0x0029: {
 			uint8_t X = (opcode & 0x0F00) >> 8;
 			I = 0x50 + (V[X] * 5);
-			std::cout << "[FX29] I = " << (int)V[X] * 5 << "\n";
+			if (trace) *trace << "[FX29] I = " << (int)V[X] * 5 << "\n";
 			break;
 		}
 		/*Fx33 - LD B, Vx
@@ -566,11 +771,13 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 			uint8_t X = (opcode & 0x0F00) >> 8;
 			uint8_t Vx = V[X];
 
-			memory[I] = Vx / 100;
-			memory[I + 1] = (Vx / 10) % 10;
-			memory[I + 2] = Vx % 10;
+			if (debugger) debugger->OnMemoryAccess(I, 3, Debugger::WATCH_WRITE);
+			MarkDirty(I, 3);
+			memory[I & 0x0FFF] = Vx / 100;
+			memory[(I + 1) & 0x0FFF] = (Vx / 10) % 10;
+			memory[(I + 2) & 0x0FFF] = Vx % 10;
 
-			std::cout << "[FX33] I = " << (int)Vx << "\n";
+			if (trace) *trace << "[FX33] I = " << (int)Vx << "\n";
 			break;
 		}
 
@@ -581,10 +788,13 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 		case 0x0055: {
 			uint8_t X = (opcode & 0x0F00) >> 8;
 
-			// X + 1 since it's size of array not index
-			memcpy(&memory[I], V, (X + 1) * sizeof(uint8_t));
+			if (debugger) debugger->OnMemoryAccess(I, X + 1, Debugger::WATCH_WRITE);
+			MarkDirty(I, X + 1);
+			// X + 1 since it's size of array not index, cut off at the end of memory
+			uint16_t addr = I & 0x0FFF;
+			memcpy(&memory[addr], V, std::min<size_t>(X + 1, sizeof(memory) - addr));
 
-			std::cout << "[FX55] Dump register from V[0] to V[" << int(X) << "]\n";
+			if (trace) *trace << "[FX55] Dump register from V[0] to V[" << int(X) << "]\n";
 			break;
 		}
 
@@ -595,16 +805,18 @@ void Chip8::ExecuteOpcode(uint16_t opcode)
 		case 0x0065: {
 			uint8_t X = (opcode & 0x0F00) >> 8;
 
-			memcpy(V, &memory[I], (X + 1) * sizeof(uint8_t));
+			if (debugger) debugger->OnMemoryAccess(I, X + 1, Debugger::WATCH_READ);
+			uint16_t addr = I & 0x0FFF;
+			memcpy(V, &memory[addr], std::min<size_t>(X + 1, sizeof(memory) - addr));
 
-			std::cout << "[FX65] Load from I to registers from V[0] to V[" << int(X) << "]\n";
+			if (trace) *trace << "[FX65] Load from I to registers from V[0] to V[" << int(X) << "]\n";
 			break;
 		}
 		}
 		break;
 	
 	default:
-		std::cerr << "Unknown opcode: " << std::hex << opcode << "\n";
+		Fault("Unknown opcode", opcode);
 		break;
 	}
 }
@@ -1,12 +1,42 @@
 #pragma once
 #include <cstdint>
+#include <iostream>
 #include <string>
+#include <vector>
+
+class Debugger;
+class StateSearch;
+
 class Chip8
 {
+	friend class Debugger;
+	friend class StateSearch;
 public:
+	// programs are loaded at 0x200, anything bigger won't fit
+	static constexpr size_t MAX_ROM_SIZE = 4096 - 0x200;
+
 	Chip8();
 	void LoadROM(const std::string& filename);
+	void LoadROM(const std::vector<uint8_t>& rom);
 	void Cycle();
+	// Runs one 60 Hz frame worth of instructions using the COSMAC VIP
+	// cycle costs, then ticks the timers once. Use instead of Cycle().
+	void RunFrame();
+	// false if the last RunFrame was cut short by the debugger
+	bool FrameCompleted() const { return !frameInterrupted; }
+
+	void SetKey(uint8_t key, bool pressed) { keypad[key & 0xF] = pressed ? 1 : 0; }
+	uint8_t ReadMemory(uint16_t addr) const { return memory[addr & 0x0FFF]; }
+	uint8_t ReadRegister(uint8_t x) const { return V[x & 0xF]; }
+	// CXKK draws from a generator inside the core, so a snapshot always has the
+	// same random future. Seed it from the clock for a different game every run.
+	void Seed(uint32_t seed) { rng = seed ? seed : DEFAULT_SEED; }
+
+	// Compact snapshot of the machine: registers, timers, the frame cycle budget, the RNG,
+	// the packed display, memory from 0x200 up to the last non-zero byte and any
+	// page below 0x200 the ROM wrote to (the rest of it is always the font).
+	std::vector<uint8_t> SaveState() const;
+	bool LoadState(const std::vector<uint8_t>& state);
 private:
 	uint8_t memory[4096]{};
 	uint8_t V[16]{};
@@ -21,8 +51,39 @@ private:
 	uint8_t delayTimer = 0;
 	uint8_t soundTimer = 0;
 	uint8_t keypad[16]{};
+
+	// set while a Debugger is attached, nullptr otherwise
+	Debugger* debugger = nullptr;
+
+	// one bit per 64 byte page of memory written since the ROM was loaded,
+	// lets state hashing skip everything that still matches the ROM
+	uint64_t dirtyPages = 0;
+	void MarkDirty(uint16_t addr, uint16_t length);
+
+	// xorshift32 state for CXKK, never 0
+	static const uint32_t DEFAULT_SEED = 0x2545F491;
+	uint32_t rng = DEFAULT_SEED;
+	uint8_t NextRandom();
+
+	// machine cycles left in the current frame, negative when a draw overran it
+	int32_t cycleBudget = 0;
+	// set when the debugger halted the core in the middle of RunFrame
+	bool frameInterrupted = false;
+
+	// fetch and execute one instruction, false if the debugger is holding the core
+	bool Step();
+	uint16_t FetchOpcode() const;
+	// bad opcodes and stack over/underflows, always printed to std::cerr and halt an attached debugger
+	void Fault(const char* message, uint16_t opcode);
+	void TickTimers();
 public:
+	// where the per-instruction log goes, nullptr turns it off so the core
+	// runs without touching iostreams (faults still go to std::cerr)
+	std::ostream* trace = &std::cout;
+
 	bool drawFlag = false;
+	// set by EX9E, EXA1 and FX0A, like drawFlag it's up to the caller to clear it
+	bool keyPolled = false;
 	uint8_t display[64 * 32]{};
 
 	void ExecuteOpcode(uint16_t opcode);
@@ -0,0 +1,482 @@
+#include "Debugger.h"
+#include "Chip8.h"
+
+#include <sstream>
+#include <iomanip>
+#include <cctype>
+#include <stdexcept>
+#include <csignal>
+
+namespace {
+
+uint16_t ParseNumber(const std::string& s)
+{
+	// accepts decimal or 0x prefixed hex, same as the addresses we print
+	size_t used = 0;
+	unsigned long value = 0;
+	try {
+		value = std::stoul(s, &used, 0);
+	}
+	catch (const std::exception&) {
+		used = 0;
+	}
+	if (used != s.size() || value > 0xFFFF) throw std::invalid_argument("bad number " + s);
+	return static_cast<uint16_t>(value);
+}
+
+// step/continue counts can go well past 16 bits
+uint32_t ParseCount(const std::string& s)
+{
+	size_t used = 0;
+	unsigned long long value = 0;
+	try {
+		value = std::stoull(s, &used, 0);
+	}
+	catch (const std::exception&) {
+		used = 0;
+	}
+	if (used != s.size() || value > 0xFFFFFFFFULL) throw std::invalid_argument("bad count " + s);
+	return static_cast<uint32_t>(value);
+}
+
+Debugger::Reg ParseReg(std::string s)
+{
+	for (auto& c : s) c = static_cast<char>(toupper(c));
+	if (s.size() == 2 && s[0] == 'V' && isxdigit(s[1])) {
+		return static_cast<Debugger::Reg>(std::stoul(s.substr(1), nullptr, 16));
+	}
+	if (s == "I") return Debugger::REG_I;
+	if (s == "DT") return Debugger::REG_DT;
+	if (s == "ST") return Debugger::REG_ST;
+	if (s == "SP") return Debugger::REG_SP;
+	throw std::invalid_argument("unknown register " + s);
+}
+
+Debugger::Op ParseOp(const std::string& s)
+{
+	if (s == "==") return Debugger::OP_EQ;
+	if (s == "!=") return Debugger::OP_NE;
+	if (s == "<") return Debugger::OP_LT;
+	if (s == ">") return Debugger::OP_GT;
+	if (s == "<=") return Debugger::OP_LE;
+	if (s == ">=") return Debugger::OP_GE;
+	throw std::invalid_argument("unknown operator " + s);
+}
+
+// reads "<reg> <op> <value>" from the stream
+Debugger::Condition ParseCondition(std::istringstream& args)
+{
+	std::string reg, op, value;
+	if (!(args >> reg >> op >> value)) throw std::invalid_argument("expected <reg> <op> <value>");
+
+	Debugger::Condition cond;
+	cond.reg = ParseReg(reg);
+	cond.op = ParseOp(op);
+	cond.value = ParseNumber(value);
+	return cond;
+}
+
+uint8_t ParseWatchFlags(const std::string& s)
+{
+	if (s == "r") return Debugger::WATCH_READ;
+	if (s == "w") return Debugger::WATCH_WRITE;
+	if (s == "rw") return Debugger::WATCH_READ | Debugger::WATCH_WRITE;
+	throw std::invalid_argument("watch mode must be r, w or rw");
+}
+
+volatile std::sig_atomic_t interrupted = 0;
+
+void OnInterrupt(int)
+{
+	interrupted = 1;
+}
+
+}
+
+Debugger::Debugger(Chip8& chip8) : chip8(chip8)
+{
+	chip8.debugger = this;
+	UpdateArmed();
+}
+
+Debugger::~Debugger()
+{
+	if (chip8.debugger == this) chip8.debugger = nullptr;
+}
+
+void Debugger::AddBreakpoint(uint16_t addr)
+{
+	AddBreakpoint(addr, Condition());
+}
+
+void Debugger::AddBreakpoint(uint16_t addr, Condition cond)
+{
+	addr &= 0x0FFF;
+	pcBreaks.set(addr);
+	if (cond.reg != REG_NONE) breakConditions[addr] = cond;
+	else breakConditions.erase(addr);
+	UpdateArmed();
+}
+
+void Debugger::RemoveBreakpoint(uint16_t addr)
+{
+	addr &= 0x0FFF;
+	pcBreaks.reset(addr);
+	breakConditions.erase(addr);
+	UpdateArmed();
+}
+
+void Debugger::AddWatchpoint(uint16_t addr, uint16_t length, uint8_t flags)
+{
+	for (uint16_t i = 0; i < length; i++) {
+		uint8_t& entry = watchMap[(addr + i) & 0x0FFF];
+		if (!entry && flags) ++watchCount;
+		entry |= flags;
+	}
+}
+
+void Debugger::RemoveWatchpoint(uint16_t addr, uint16_t length)
+{
+	for (uint16_t i = 0; i < length; i++) {
+		uint8_t& entry = watchMap[(addr + i) & 0x0FFF];
+		if (entry) --watchCount;
+		entry = 0;
+	}
+}
+
+void Debugger::AddTrap(Condition cond)
+{
+	traps.push_back(cond);
+	UpdateArmed();
+}
+
+void Debugger::ClearTraps()
+{
+	traps.clear();
+	UpdateArmed();
+}
+
+void Debugger::Step(uint32_t count)
+{
+	halted = false;
+	resuming = true;
+	stepping = true;
+	stepsLeft = count;
+	stepReason = "step";
+	UpdateArmed();
+}
+
+void Debugger::StepOver()
+{
+	uint16_t opcode = chip8.FetchOpcode();
+	if ((opcode & 0xF000) != 0x2000) {
+		Step();
+		return;
+	}
+
+	// break once we're back at the instruction after the CALL at the same depth
+	halted = false;
+	resuming = true;
+	stepOverActive = true;
+	stepOverPc = chip8.pc + 2;
+	stepOverSp = chip8.sp;
+	UpdateArmed();
+}
+
+void Debugger::Continue(uint32_t limit)
+{
+	halted = false;
+	resuming = true;
+	// a limited continue is just a long step that reports differently
+	stepping = limit != 0;
+	stepsLeft = limit;
+	stepReason = "continue limit reached";
+	stepOverActive = false;
+	UpdateArmed();
+}
+
+void Debugger::RunFrames(uint32_t count)
+{
+	Continue();
+	framesLeft = count;
+}
+
+void Debugger::Halt(const std::string& reason)
+{
+	framesLeft = 0;
+	halted = true;
+	stepping = false;
+	stepOverActive = false;
+	haltReason = reason;
+	UpdateArmed();
+}
+
+void Debugger::UpdateArmed()
+{
+	armed = halted || resuming || stepping || stepOverActive || pendingHalt
+		|| pcBreaks.any() || !traps.empty();
+}
+
+bool Debugger::CheckBreak(uint16_t pc)
+{
+	if (halted) return true;
+
+	// watchpoints and faults fire after the instruction that caused them has finished
+	if (pendingHalt) {
+		pendingHalt = false;
+		Halt(haltReason);
+		return true;
+	}
+
+	if (!resuming) {
+		if (stepOverActive && pc == stepOverPc && chip8.sp == stepOverSp) {
+			Halt("step over");
+			return true;
+		}
+
+		if (pcBreaks[pc & 0x0FFF]) {
+			auto it = breakConditions.find(pc & 0x0FFF);
+			if (it == breakConditions.end() || Evaluate(it->second)) {
+				std::ostringstream reason;
+				reason << "breakpoint at 0x" << std::hex << pc;
+				Halt(reason.str());
+				return true;
+			}
+		}
+
+		for (const auto& trap : traps) {
+			if (Evaluate(trap)) {
+				std::ostringstream reason;
+				reason << "trap at 0x" << std::hex << pc;
+				Halt(reason.str());
+				return true;
+			}
+		}
+	}
+	resuming = false;
+
+	if (stepping) {
+		if (stepsLeft == 0) {
+			Halt(stepReason);
+			return true;
+		}
+		--stepsLeft;
+	}
+
+	UpdateArmed();
+	return false;
+}
+
+void Debugger::CheckWatch(uint16_t addr, uint16_t length, uint8_t flags)
+{
+	for (uint16_t i = 0; i < length; i++) {
+		uint16_t a = (addr + i) & 0x0FFF;
+		if (watchMap[a] & flags) {
+			std::ostringstream reason;
+			reason << "watchpoint " << ((flags & WATCH_WRITE) ? "write" : "read")
+				<< " at 0x" << std::hex << a << " by instruction at 0x" << (chip8.pc - 2);
+			haltReason = reason.str();
+			pendingHalt = true;
+			armed = true;
+			return;
+		}
+	}
+}
+
+void Debugger::OnFault(const std::string& message)
+{
+	haltReason = message.substr(0, message.find('\n'));
+	pendingHalt = true;
+	armed = true;
+}
+
+bool Debugger::Evaluate(const Condition& cond) const
+{
+	uint16_t value;
+	switch (cond.reg) {
+	case REG_I: value = chip8.I; break;
+	case REG_DT: value = chip8.delayTimer; break;
+	case REG_ST: value = chip8.soundTimer; break;
+	case REG_SP: value = chip8.sp; break;
+	case REG_NONE: return true;
+	default: value = chip8.V[cond.reg & 0xF]; break;
+	}
+
+	switch (cond.op) {
+	case OP_EQ: return value == cond.value;
+	case OP_NE: return value != cond.value;
+	case OP_LT: return value < cond.value;
+	case OP_GT: return value > cond.value;
+	case OP_LE: return value <= cond.value;
+	case OP_GE: return value >= cond.value;
+	}
+	return false;
+}
+
+void Debugger::RunConsole(std::istream& in, std::ostream& out)
+{
+	std::ostream* savedTrace = chip8.trace;
+	chip8.trace = nullptr;
+	auto savedHandler = std::signal(SIGINT, OnInterrupt);
+
+	std::string line;
+	while (true) {
+		if (!halted) {
+			if (interrupted) {
+				interrupted = 0;
+				Halt("interrupted");
+				continue;
+			}
+			if (!vipTiming) {
+				chip8.Cycle();
+				continue;
+			}
+
+			chip8.RunFrame();
+			if (!halted && framesLeft && chip8.FrameCompleted() && --framesLeft == 0) Halt("frame");
+			continue;
+		}
+
+		if (!haltReason.empty()) {
+			out << "Halted: " << haltReason << "\n";
+			haltReason.clear();
+		}
+		out << "(chip8) " << std::flush;
+		if (!std::getline(in, line)) break;
+		// a Ctrl+C at the prompt has nothing to stop, don't let it halt the next run
+		interrupted = 0;
+		if (!ExecuteCommand(line, out)) break;
+	}
+
+	std::signal(SIGINT, savedHandler);
+	chip8.trace = savedTrace;
+}
+
+bool Debugger::ExecuteCommand(const std::string& line, std::ostream& out)
+{
+	std::istringstream args(line);
+	std::string cmd;
+	if (!(args >> cmd)) return true;
+
+	try {
+		if (cmd == "b" || cmd == "break") {
+			std::string addr, keyword;
+			if (!(args >> addr)) throw std::invalid_argument("usage: break <addr> [if <reg> <op> <value>]");
+			Condition cond;
+			if (args >> keyword) {
+				if (keyword != "if") throw std::invalid_argument("expected 'if'");
+				cond = ParseCondition(args);
+			}
+			AddBreakpoint(ParseNumber(addr), cond);
+		}
+		else if (cmd == "d" || cmd == "delete") {
+			std::string addr;
+			if (!(args >> addr)) throw std::invalid_argument("usage: delete <addr>");
+			RemoveBreakpoint(ParseNumber(addr));
+		}
+		else if (cmd == "w" || cmd == "watch") {
+			std::string addr, length = "1", mode = "rw";
+			if (!(args >> addr)) throw std::invalid_argument("usage: watch <addr> [length] [r|w|rw]");
+			args >> length >> mode;
+			AddWatchpoint(ParseNumber(addr), ParseNumber(length), ParseWatchFlags(mode));
+		}
+		else if (cmd == "unwatch") {
+			std::string addr, length = "1";
+			if (!(args >> addr)) throw std::invalid_argument("usage: unwatch <addr> [length]");
+			args >> length;
+			RemoveWatchpoint(ParseNumber(addr), ParseNumber(length));
+		}
+		else if (cmd == "trap") {
+			AddTrap(ParseCondition(args));
+		}
+		else if (cmd == "untrap") {
+			ClearTraps();
+		}
+		else if (cmd == "s" || cmd == "step") {
+			std::string count = "1";
+			args >> count;
+			Step(ParseCount(count));
+		}
+		else if (cmd == "n" || cmd == "next") {
+			StepOver();
+		}
+		else if (cmd == "c" || cmd == "continue") {
+			std::string limit = "0";
+			args >> limit;
+			Continue(ParseCount(limit));
+		}
+		else if (cmd == "f" || cmd == "frame") {
+			if (!vipTiming) throw std::invalid_argument("frame needs --vip-timing");
+			std::string count = "1";
+			args >> count;
+			RunFrames(ParseCount(count));
+		}
+		else if (cmd == "trace") {
+			std::string state;
+			if (!(args >> state) || (state != "on" && state != "off")) throw std::invalid_argument("usage: trace on|off");
+			chip8.trace = state == "on" ? &std::cerr : nullptr;
+		}
+		else if (cmd == "r" || cmd == "regs") {
+			PrintRegisters(out);
+		}
+		else if (cmd == "m" || cmd == "mem") {
+			std::string addr, length = "16";
+			if (!(args >> addr)) throw std::invalid_argument("usage: mem <addr> [length]");
+			args >> length;
+			PrintMemory(out, ParseNumber(addr), ParseNumber(length));
+		}
+		else if (cmd == "stack") {
+			PrintStack(out);
+		}
+		else if (cmd == "key") {
+			std::string key, state;
+			if (!(args >> key >> state)) throw std::invalid_argument("usage: key <0-F> <0|1>");
+			chip8.keypad[std::stoul(key, nullptr, 16) & 0xF] = ParseNumber(state) ? 1 : 0;
+		}
+		else if (cmd == "q" || cmd == "quit") {
+			return false;
+		}
+		else {
+			out << "Unknown command: " << cmd << "\n";
+		}
+	}
+	catch (const std::exception& e) {
+		out << "Error: " << e.what() << "\n";
+	}
+	return true;
+}
+
+void Debugger::PrintRegisters(std::ostream& out) const
+{
+	out << std::hex << std::uppercase << std::setfill('0');
+	for (int i = 0; i < 16; i++) {
+		out << "V" << i << "=" << std::setw(2) << (int)chip8.V[i] << (i % 8 == 7 ? "\n" : " ");
+	}
+	out << "PC=" << std::setw(3) << chip8.pc
+		<< " I=" << std::setw(3) << chip8.I
+		<< " SP=" << (int)chip8.sp
+		<< " DT=" << std::setw(2) << (int)chip8.delayTimer
+		<< " ST=" << std::setw(2) << (int)chip8.soundTimer << "\n";
+	out << std::dec << std::nouppercase << std::setfill(' ');
+}
+
+void Debugger::PrintMemory(std::ostream& out, uint16_t addr, uint16_t length) const
+{
+	out << std::hex << std::uppercase << std::setfill('0');
+	for (uint16_t i = 0; i < length; i++) {
+		uint16_t a = (addr + i) & 0x0FFF;
+		if (i % 16 == 0) out << std::setw(3) << a << ":";
+		out << " " << std::setw(2) << (int)chip8.memory[a];
+		if (i % 16 == 15 || i + 1 == length) out << "\n";
+	}
+	out << std::dec << std::nouppercase << std::setfill(' ');
+}
+
+void Debugger::PrintStack(std::ostream& out) const
+{
+	out << std::hex << std::uppercase << std::setfill('0');
+	for (int i = chip8.sp - 1; i >= 0; i--) {
+		out << "#" << std::dec << (chip8.sp - 1 - i) << std::hex << " " << std::setw(3) << chip8.stack[i] << "\n";
+	}
+	out << std::dec << std::nouppercase << std::setfill(' ');
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <bitset>
+#include <map>
+#include <vector>
+#include <string>
+#include <iostream>
+
+class Chip8;
+
+// Breakpoints, watchpoints and conditional traps for a Chip8 core.
+// Everything is kept in bitmaps indexed by address so the per-instruction
+// check is a single flag test while nothing is set.
+class Debugger
+{
+public:
+	enum WatchFlags : uint8_t { WATCH_READ = 0x1, WATCH_WRITE = 0x2 };
+
+	// registers a condition can test, V0-VF map directly onto 0x0-0xF
+	enum Reg : uint8_t { REG_V0 = 0x0, REG_VF = 0xF, REG_I, REG_DT, REG_ST, REG_SP, REG_NONE };
+	enum Op : uint8_t { OP_EQ, OP_NE, OP_LT, OP_GT, OP_LE, OP_GE };
+
+	struct Condition {
+		Reg reg = REG_NONE; // REG_NONE means always true
+		Op op = OP_EQ;
+		uint16_t value = 0;
+	};
+
+	// attaches itself to the core, the core starts out halted
+	explicit Debugger(Chip8& chip8);
+	~Debugger();
+
+	void AddBreakpoint(uint16_t addr);
+	void AddBreakpoint(uint16_t addr, Condition cond);
+	void RemoveBreakpoint(uint16_t addr);
+	void AddWatchpoint(uint16_t addr, uint16_t length, uint8_t flags);
+	void RemoveWatchpoint(uint16_t addr, uint16_t length);
+	void AddTrap(Condition cond);
+	void ClearTraps();
+
+	void Step(uint32_t count = 1);
+	// same as Step, except a CALL runs until its matching return
+	void StepOver();
+	// runs until something halts the core, or for at most limit instructions
+	void Continue(uint32_t limit = 0);
+	void Halt(const std::string& reason);
+	bool IsHalted() const { return halted; }
+
+	// Drive the core with Chip8::RunFrame instead of Cycle in RunConsole, so
+	// ROMs are debugged under the VIP timing model they really run with.
+	void SetVipTiming(bool enabled) { vipTiming = enabled; }
+	// VIP timing only, runs n whole frames then halts
+	void RunFrames(uint32_t count);
+
+	// called by Chip8::Cycle before every fetch, true means don't execute
+	bool OnFetch(uint16_t pc) { return armed && CheckBreak(pc); }
+	// called by Chip8 whenever an instruction touches memory through I
+	void OnMemoryAccess(uint16_t addr, uint16_t length, uint8_t flags) { if (watchCount) CheckWatch(addr, length, flags); }
+	// called by Chip8 on an unknown opcode or stack overflow, halts before the next fetch
+	void OnFault(const std::string& message);
+
+	// Headless command interface, runs until "quit" or end of input. The core's
+	// trace is off while it runs ("trace on" sends it to stderr) so out only
+	// ever gets prompts and replies. Ctrl+C halts a running core.
+	void RunConsole(std::istream& in, std::ostream& out);
+	// returns false once the session should end
+	bool ExecuteCommand(const std::string& line, std::ostream& out);
+
+private:
+	Chip8& chip8;
+
+	std::bitset<4096> pcBreaks;
+	std::map<uint16_t, Condition> breakConditions;
+	uint8_t watchMap[4096]{};
+	uint32_t watchCount = 0;
+	std::vector<Condition> traps;
+
+	bool armed = false;
+	bool halted = true;
+	bool resuming = false; // skip breakpoints on the instruction we stopped at
+	bool stepping = false;
+	uint32_t stepsLeft = 0;
+	const char* stepReason = "step"; // what a finished step or limited continue reports
+	bool vipTiming = false;
+	uint32_t framesLeft = 0;
+	bool stepOverActive = false;
+	uint16_t stepOverPc = 0;
+	uint8_t stepOverSp = 0;
+	bool pendingHalt = false; // a watchpoint or fault, halts before the next fetch
+	std::string haltReason;
+
+	void UpdateArmed();
+	bool CheckBreak(uint16_t pc);
+	void CheckWatch(uint16_t addr, uint16_t length, uint8_t flags);
+	bool Evaluate(const Condition& cond) const;
+
+	void PrintRegisters(std::ostream& out) const;
+	void PrintMemory(std::ostream& out, uint16_t addr, uint16_t length) const;
+	void PrintStack(std::ostream& out) const;
+};
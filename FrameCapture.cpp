@@ -0,0 +1,396 @@
+#include "FrameCapture.h"
+#include "ByteIO.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char HEADER_MAGIC[5] = { 'C', '8', 'C', 'A', 'P' };
+const char FOOTER_MAGIC[4] = { 'C', '8', 'I', 'X' };
+const uint8_t VERSION = 1;
+const size_t HEADER_SIZE = 10;
+const size_t FOOTER_SIZE = 20;
+const size_t MIN_RECORD_SIZE = 4; // type, length and at least one payload byte
+
+enum FrameType : uint8_t { KEYFRAME = 0, DELTA = 1 };
+
+// same grey the SDL frontend draws pixels with
+const uint8_t PIXEL_ON = 0xE0;
+
+// [zero run][literal count][literals] blocks, XOR deltas are mostly zeros
+void Encode(const uint8_t* in, size_t length, std::vector<uint8_t>& out)
+{
+	size_t i = 0;
+	while (i < length) {
+		uint8_t zeros = 0;
+		while (i < length && in[i] == 0 && zeros < 255) {
+			zeros++;
+			i++;
+		}
+
+		size_t start = i;
+		uint8_t literals = 0;
+		// a single zero is cheaper as a literal than starting a new block
+		while (i < length && literals < 255 && !(in[i] == 0 && (i + 1 >= length || in[i + 1] == 0))) {
+			literals++;
+			i++;
+		}
+
+		out.push_back(zeros);
+		out.push_back(literals);
+		out.insert(out.end(), in + start, in + start + literals);
+	}
+}
+
+bool Decode(const uint8_t* in, size_t length, uint8_t* out, size_t outLength)
+{
+	std::memset(out, 0, outLength);
+	size_t pos = 0;
+	size_t i = 0;
+	while (i + 2 <= length) {
+		pos += in[i];
+		uint8_t literals = in[i + 1];
+		i += 2;
+		if (pos + literals > outLength || i + literals > length) return false;
+		std::memcpy(out + pos, in + i, literals);
+		pos += literals;
+		i += literals;
+	}
+	return i == length;
+}
+
+}
+
+void FrameCapture::Pack(const uint8_t* display, PackedFrame& packed)
+{
+	for (int i = 0; i < PACKED_SIZE; i++) {
+		const uint8_t* pixels = display + i * 8;
+		packed[i] = static_cast<uint8_t>(
+			((pixels[0] & 1) << 7) | ((pixels[1] & 1) << 6) | ((pixels[2] & 1) << 5) | ((pixels[3] & 1) << 4) |
+			((pixels[4] & 1) << 3) | ((pixels[5] & 1) << 2) | ((pixels[6] & 1) << 1) | (pixels[7] & 1));
+	}
+}
+
+void FrameCapture::Unpack(const PackedFrame& packed, uint8_t* display)
+{
+	for (int i = 0; i < WIDTH * HEIGHT; i++) {
+		display[i] = (packed[i / 8] >> (7 - i % 8)) & 1;
+	}
+}
+
+CaptureWriter::~CaptureWriter()
+{
+	Close();
+}
+
+bool CaptureWriter::Open(const std::string& filename, uint16_t keyframeInterval)
+{
+	file.open(filename, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		std::cerr << "Failed to open capture: " << filename << "\n";
+		return false;
+	}
+
+	this->keyframeInterval = keyframeInterval ? keyframeInterval : 1;
+	frameCount = 0;
+	keyframes.clear();
+	closing = false;
+
+	std::vector<uint8_t> header(HEADER_MAGIC, HEADER_MAGIC + sizeof(HEADER_MAGIC));
+	ByteIO::Put(header, VERSION, 1);
+	ByteIO::Put(header, FrameCapture::WIDTH, 1);
+	ByteIO::Put(header, FrameCapture::HEIGHT, 1);
+	ByteIO::Put(header, this->keyframeInterval, 2);
+	file.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+	thread = std::thread(&CaptureWriter::WriterLoop, this);
+	return true;
+}
+
+void CaptureWriter::Push(const uint8_t* display)
+{
+	// nothing would ever drain the queue
+	if (!thread.joinable()) return;
+
+	// packing is the only per-frame work done on the caller's thread
+	FrameCapture::PackedFrame frame;
+	FrameCapture::Pack(display, frame);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.push_back(frame);
+	}
+	wake.notify_one();
+}
+
+void CaptureWriter::Close()
+{
+	if (!thread.joinable()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+	}
+	wake.notify_one();
+	thread.join();
+
+	std::vector<uint8_t> index;
+	uint64_t indexOffset = static_cast<uint64_t>(file.tellp());
+	for (const auto& keyframe : keyframes) {
+		ByteIO::Put(index, keyframe.first, 4);
+		ByteIO::Put(index, keyframe.second, 8);
+	}
+	ByteIO::Put(index, indexOffset, 8);
+	ByteIO::Put(index, keyframes.size(), 4);
+	ByteIO::Put(index, frameCount, 4);
+	index.insert(index.end(), FOOTER_MAGIC, FOOTER_MAGIC + sizeof(FOOTER_MAGIC));
+	file.write(reinterpret_cast<const char*>(index.data()), index.size());
+	file.close();
+}
+
+void CaptureWriter::WriterLoop()
+{
+	std::vector<FrameCapture::PackedFrame> batch;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this]() { return closing || !pending.empty(); });
+			// swap so the emulation thread never waits on encoding or disk
+			batch.swap(pending);
+			if (batch.empty() && closing) return;
+		}
+
+		for (const auto& frame : batch) WriteFrame(frame);
+		batch.clear();
+		// keep what's on disk readable if the process dies before Close
+		file.flush();
+	}
+}
+
+void CaptureWriter::WriteFrame(const FrameCapture::PackedFrame& frame)
+{
+	bool keyframe = frameCount % keyframeInterval == 0;
+	if (keyframe) keyframes.emplace_back(frameCount, static_cast<uint64_t>(file.tellp()));
+
+	FrameCapture::PackedFrame payload;
+	for (int i = 0; i < FrameCapture::PACKED_SIZE; i++) {
+		payload[i] = keyframe ? frame[i] : frame[i] ^ previous[i];
+	}
+
+	encoded.clear();
+	ByteIO::Put(encoded, keyframe ? KEYFRAME : DELTA, 1);
+	ByteIO::Put(encoded, 0, 2); // length, filled in below
+	Encode(payload.data(), payload.size(), encoded);
+	size_t length = encoded.size() - 3;
+	encoded[1] = static_cast<uint8_t>(length);
+	encoded[2] = static_cast<uint8_t>(length >> 8);
+	file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+
+	previous = frame;
+	frameCount++;
+}
+
+bool CaptureReader::Open(const std::string& filename)
+{
+	file.open(filename, std::ios::binary);
+	if (!file) {
+		std::cerr << "Failed to open capture: " << filename << "\n";
+		return false;
+	}
+
+	uint8_t header[HEADER_SIZE];
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!file || memcmp(header, HEADER_MAGIC, sizeof(HEADER_MAGIC)) != 0 || header[5] != VERSION
+		|| header[6] != FrameCapture::WIDTH || header[7] != FrameCapture::HEIGHT) {
+		std::cerr << "Not a capture file: " << filename << "\n";
+		return false;
+	}
+
+	nextFrame = 0;
+	nextOffset = HEADER_SIZE;
+	if (ReadIndex()) return true;
+
+	// no valid footer means the recorder never got to Close (crash, kill) or the
+	// index is damaged, the frame records carry their own type and length so it can be rebuilt
+	std::cerr << "Capture has no valid index, rebuilding it: " << filename << "\n";
+	RebuildIndex();
+	return true;
+}
+
+bool CaptureReader::ReadIndex()
+{
+	uint8_t footer[FOOTER_SIZE];
+	file.clear();
+	file.seekg(0, std::ios::end);
+	uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+	if (fileSize < HEADER_SIZE + FOOTER_SIZE) return false;
+
+	file.seekg(-static_cast<std::streamoff>(FOOTER_SIZE), std::ios::end);
+	file.read(reinterpret_cast<char*>(footer), sizeof(footer));
+	if (!file || memcmp(footer + 16, FOOTER_MAGIC, sizeof(FOOTER_MAGIC)) != 0) return false;
+
+	uint64_t indexOffset = ByteIO::Get(footer, 8);
+	uint32_t keyframeCount = static_cast<uint32_t>(ByteIO::Get(footer + 8, 4));
+	if (indexOffset + keyframeCount * 12ULL + FOOTER_SIZE != fileSize) return false;
+
+	std::vector<uint8_t> index(keyframeCount * 12);
+	file.seekg(static_cast<std::streamoff>(indexOffset));
+	file.read(reinterpret_cast<char*>(index.data()), index.size());
+	if (!file) return false;
+
+	// don't trust the table, seeking relies on it starting at frame 0 and
+	// going strictly forward through frames and records that exist
+	uint32_t frames = static_cast<uint32_t>(ByteIO::Get(footer + 12, 4));
+	if ((keyframeCount == 0) != (frames == 0)) return false;
+
+	keyframes.clear();
+	for (uint32_t i = 0; i < keyframeCount; i++) {
+		uint32_t frame = static_cast<uint32_t>(ByteIO::Get(&index[i * 12], 4));
+		uint64_t offset = ByteIO::Get(&index[i * 12 + 4], 8);
+		if (keyframes.empty() ? (frame != 0 || offset != HEADER_SIZE)
+			: (frame <= keyframes.back().first
+				|| offset < keyframes.back().second + (frame - keyframes.back().first) * MIN_RECORD_SIZE)) return false;
+		if (frame >= frames || offset >= indexOffset) return false;
+		keyframes.emplace_back(frame, offset);
+	}
+	if (!keyframes.empty()
+		&& indexOffset < keyframes.back().second + uint64_t(frames - keyframes.back().first) * MIN_RECORD_SIZE) return false;
+	frameCount = frames;
+	return true;
+}
+
+void CaptureReader::RebuildIndex()
+{
+	keyframes.clear();
+	frameCount = 0;
+
+	file.clear();
+	file.seekg(0, std::ios::end);
+	uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+
+	uint64_t offset = HEADER_SIZE;
+	uint8_t record[3];
+	while (offset + sizeof(record) <= fileSize) {
+		file.seekg(static_cast<std::streamoff>(offset));
+		file.read(reinterpret_cast<char*>(record), sizeof(record));
+		if (!file || record[0] > DELTA) break;
+
+		// a record cut off by the crash is dropped along with everything after it,
+		// the encoder never writes an empty payload so that means we hit garbage
+		uint64_t length = ByteIO::Get(record + 1, 2);
+		uint64_t end = offset + sizeof(record) + length;
+		if (length == 0 || end > fileSize) break;
+		// a delta needs a keyframe before it
+		if (record[0] == DELTA && keyframes.empty()) break;
+
+		if (record[0] == KEYFRAME) keyframes.emplace_back(frameCount, offset);
+		offset = end;
+		frameCount++;
+	}
+	file.clear();
+}
+
+bool CaptureReader::ReadFrame(uint32_t frame, uint8_t* display)
+{
+	if (frame >= frameCount || keyframes.empty()) return false;
+
+	if (frame + 1 != nextFrame) {
+		// nearest keyframe at or before the frame we want
+		auto keyframe = std::upper_bound(keyframes.begin(), keyframes.end(), frame,
+			[](uint32_t f, const std::pair<uint32_t, uint64_t>& k) { return f < k.first; }) - 1;
+
+		// only seek when it saves decoding, reading forward just continues
+		if (frame < nextFrame || keyframe->first > nextFrame) {
+			nextFrame = keyframe->first;
+			nextOffset = keyframe->second;
+		}
+		while (nextFrame <= frame) {
+			if (!DecodeNext()) return false;
+		}
+	}
+
+	FrameCapture::Unpack(current, display);
+	return true;
+}
+
+bool CaptureReader::DecodeNext()
+{
+	uint8_t record[3];
+	file.clear();
+	file.seekg(static_cast<std::streamoff>(nextOffset));
+	file.read(reinterpret_cast<char*>(record), sizeof(record));
+
+	std::vector<uint8_t> payload(static_cast<size_t>(ByteIO::Get(record + 1, 2)));
+	file.read(reinterpret_cast<char*>(payload.data()), payload.size());
+
+	FrameCapture::PackedFrame decoded;
+	if (!file || record[0] > DELTA || !Decode(payload.data(), payload.size(), decoded.data(), decoded.size())) {
+		std::cerr << "Corrupt capture frame " << nextFrame << "\n";
+		return false;
+	}
+
+	for (int i = 0; i < FrameCapture::PACKED_SIZE; i++) {
+		current[i] = record[0] == KEYFRAME ? decoded[i] : current[i] ^ decoded[i];
+	}
+	nextOffset += sizeof(record) + payload.size();
+	nextFrame++;
+	return true;
+}
+
+bool CaptureReader::WritePPM(const std::string& filename, uint32_t frame, int scale)
+{
+	uint8_t display[FrameCapture::WIDTH * FrameCapture::HEIGHT];
+	if (!ReadFrame(frame, display)) return false;
+
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) {
+		std::cerr << "Failed to open output: " << filename << "\n";
+		return false;
+	}
+
+	out << "P6\n" << FrameCapture::WIDTH * scale << " " << FrameCapture::HEIGHT * scale << "\n255\n";
+	std::vector<uint8_t> row(FrameCapture::WIDTH * scale * 3);
+	for (int y = 0; y < FrameCapture::HEIGHT; y++) {
+		for (int x = 0; x < FrameCapture::WIDTH * scale; x++) {
+			uint8_t value = display[y * FrameCapture::WIDTH + x / scale] ? PIXEL_ON : 0;
+			row[x * 3] = row[x * 3 + 1] = row[x * 3 + 2] = value;
+		}
+		for (int i = 0; i < scale; i++) out.write(reinterpret_cast<const char*>(row.data()), row.size());
+	}
+	return static_cast<bool>(out);
+}
+
+bool CaptureReader::WriteY4M(const std::string& filename, uint32_t first, uint32_t count, int scale)
+{
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) {
+		std::cerr << "Failed to open output: " << filename << "\n";
+		return false;
+	}
+
+	int width = FrameCapture::WIDTH * scale;
+	int height = FrameCapture::HEIGHT * scale;
+	out << "YUV4MPEG2 W" << width << " H" << height << " F60:1 Ip A1:1 C420jpeg\n";
+
+	uint8_t display[FrameCapture::WIDTH * FrameCapture::HEIGHT];
+	std::vector<uint8_t> luma(width * height);
+	// greyscale, so chroma is the same neutral plane every frame
+	std::vector<uint8_t> chroma((width / 2) * (height / 2) * 2, 128);
+
+	uint32_t last = std::min(frameCount, first + count);
+	for (uint32_t frame = first; frame < last; frame++) {
+		if (!ReadFrame(frame, display)) return false;
+
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				luma[y * width + x] = display[(y / scale) * FrameCapture::WIDTH + x / scale] ? PIXEL_ON : 0;
+			}
+		}
+		out << "FRAME\n";
+		out.write(reinterpret_cast<const char*>(luma.data()), luma.size());
+		out.write(reinterpret_cast<const char*>(chroma.data()), chroma.size());
+	}
+	return static_cast<bool>(out);
+}
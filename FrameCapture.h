@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Capture file layout (all integers little endian):
+//   header  "C8CAP" version(u8) width(u8) height(u8) keyframeInterval(u16)
+//   frames  type(u8, 0 = keyframe, 1 = delta) length(u16) payload
+//   index   per keyframe: frame number(u32) file offset(u64)
+//   footer  index offset(u64) keyframe count(u32) frame count(u32) "C8IX"
+// The index and footer are only written on Close, a file without them (the
+// recorder was killed) or with a damaged index is still readable by scanning
+// the frame records. Frames are 1/60 s apart.
+// Frames are the display packed to 1 bit per pixel (256 bytes). Keyframes
+// store the packed frame, deltas store it XORed with the previous one, both
+// run length coded as repeated [zero run(u8) literal count(u8) literals...].
+namespace FrameCapture {
+	const int WIDTH = 64;
+	const int HEIGHT = 32;
+	const int PACKED_SIZE = WIDTH * HEIGHT / 8;
+	using PackedFrame = std::array<uint8_t, PACKED_SIZE>;
+
+	void Pack(const uint8_t* display, PackedFrame& packed);
+	void Unpack(const PackedFrame& packed, uint8_t* display);
+}
+
+// Records frames from the emulation thread. Push only packs the display and
+// queues it, encoding and file writes happen on a background thread.
+class CaptureWriter
+{
+public:
+	CaptureWriter() = default;
+	~CaptureWriter();
+
+	bool Open(const std::string& filename, uint16_t keyframeInterval = 300);
+	// display is Chip8::display, one byte per pixel
+	void Push(const uint8_t* display);
+	// flushes the queue and writes the seek index
+	void Close();
+
+private:
+	std::ofstream file;
+	uint16_t keyframeInterval = 300;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::vector<FrameCapture::PackedFrame> pending;
+	bool closing = false;
+
+	// only touched by the writer thread
+	FrameCapture::PackedFrame previous{};
+	uint32_t frameCount = 0;
+	std::vector<std::pair<uint32_t, uint64_t>> keyframes;
+	std::vector<uint8_t> encoded;
+
+	void WriterLoop();
+	void WriteFrame(const FrameCapture::PackedFrame& frame);
+};
+
+// Random access decoding of a capture file through its keyframe index.
+class CaptureReader
+{
+public:
+	bool Open(const std::string& filename);
+	uint32_t FrameCount() const { return frameCount; }
+
+	// display gets one byte per pixel like Chip8::display
+	bool ReadFrame(uint32_t frame, uint8_t* display);
+
+	bool WritePPM(const std::string& filename, uint32_t frame, int scale = 1);
+	bool WriteY4M(const std::string& filename, uint32_t first, uint32_t count, int scale = 1);
+
+private:
+	std::ifstream file;
+	uint32_t frameCount = 0;
+	std::vector<std::pair<uint32_t, uint64_t>> keyframes;
+
+	// decoder position, so reading frames in order doesn't go back to a keyframe
+	uint32_t nextFrame = 0;
+	uint64_t nextOffset = 0;
+	FrameCapture::PackedFrame current{};
+
+	bool DecodeNext();
+	// index from the footer, false if there isn't a valid one
+	bool ReadIndex();
+	// scans the frame records when the file was never closed
+	void RebuildIndex();
+};
@@ -0,0 +1,291 @@
+#include "RomLibrary.h"
+#include "ByteIO.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char INDEX_MAGIC[5] = { 'C', '8', 'L', 'I', 'B' };
+const uint8_t VERSION = 3;
+const size_t HEADER_SIZE = 14;
+// hash, size, platform, quirks, ipf, snapshot offset and size, two empty strings
+const size_t MIN_ENTRY_SIZE = 8 + 4 + 1 + 1 + 2 + 8 + 4 + 2 + 2;
+
+const char* const ROM_EXTENSIONS[] = { ".ch8", ".c8", ".sc8", ".xo8" };
+
+void PutString(std::vector<uint8_t>& out, const std::string& s)
+{
+	ByteIO::Put(out, s.size(), 2);
+	out.insert(out.end(), s.begin(), s.end());
+}
+
+bool GetString(const std::vector<uint8_t>& in, size_t& pos, std::string& s)
+{
+	uint64_t length;
+	if (!ByteIO::Read(in, pos, length, 2) || pos + length > in.size()) return false;
+	s.assign(in.begin() + pos, in.begin() + pos + length);
+	pos += length;
+	return true;
+}
+
+bool IsRomFile(const fs::path& path)
+{
+	std::string extension = path.extension().string();
+	for (auto& c : extension) c = static_cast<char>(tolower(c));
+	for (const char* rom : ROM_EXTENSIONS) {
+		if (extension == rom) return true;
+	}
+	return false;
+}
+
+}
+
+uint64_t RomLibrary::HashRom(const std::vector<uint8_t>& rom)
+{
+	// FNV-1a, ROMs are a few KB so it doesn't need to be anything fancier
+	uint64_t h = 0xCBF29CE484222325ULL;
+	for (uint8_t byte : rom) {
+		h ^= byte;
+		h *= 0x100000001B3ULL;
+	}
+	return h;
+}
+
+void RomLibrary::Detect(const std::vector<uint8_t>& rom, Entry& entry)
+{
+	// Count opcodes only the later platforms have. Code and data are mixed in a
+	// ROM so a single hit could just be sprite bytes, it takes two to count.
+	int schip = 0;
+	int xochip = 0;
+	for (size_t i = 0; i + 1 < rom.size(); i += 2) {
+		uint16_t opcode = (rom[i] << 8) | rom[i + 1];
+		switch (opcode & 0xF000) {
+		case 0x0000:
+			if ((opcode & 0xFFF0) == 0x00C0 || (opcode >= 0x00FB && opcode <= 0x00FF)) schip++;
+			else if ((opcode & 0xFFF0) == 0x00D0) xochip++;
+			break;
+		case 0x5000:
+			if ((opcode & 0x000F) == 0x2 || (opcode & 0x000F) == 0x3) xochip++;
+			break;
+		case 0xD000:
+			if ((opcode & 0x000F) == 0) schip++;
+			break;
+		case 0xF000:
+			if (opcode == 0xF000 || opcode == 0xF002 || (opcode & 0x00FF) == 0x01 || (opcode & 0x00FF) == 0x3A) xochip++;
+			else if ((opcode & 0x00FF) == 0x30 || (opcode & 0x00FF) == 0x75 || (opcode & 0x00FF) == 0x85) schip++;
+			break;
+		}
+	}
+
+	if (rom.size() > Chip8::MAX_ROM_SIZE || xochip >= 2) {
+		entry.platform = PLATFORM_XOCHIP;
+		entry.quirks = QUIRK_MEMORY_INCREMENT;
+		entry.instructionsPerFrame = 1000;
+	}
+	else if (schip >= 2) {
+		entry.platform = PLATFORM_SCHIP;
+		entry.quirks = QUIRK_CLIPPING | QUIRK_SHIFT_VX | QUIRK_JUMP_VX;
+		entry.instructionsPerFrame = 30;
+	}
+	else {
+		// original COSMAC VIP behaviour
+		entry.platform = PLATFORM_CHIP8;
+		entry.quirks = QUIRK_VF_RESET | QUIRK_MEMORY_INCREMENT | QUIRK_DISPLAY_WAIT | QUIRK_CLIPPING;
+		entry.instructionsPerFrame = 11;
+	}
+}
+
+bool RomLibrary::Build(const std::string& indexFile, const std::vector<std::string>& directories, uint32_t bootFrames)
+{
+	std::vector<fs::path> paths;
+	for (const auto& directory : directories) {
+		std::error_code error;
+		fs::recursive_directory_iterator it(directory, fs::directory_options::skip_permission_denied, error);
+		if (error) {
+			std::cerr << "Failed to scan " << directory << ": " << error.message() << "\n";
+			continue;
+		}
+		for (; it != fs::recursive_directory_iterator(); it.increment(error)) {
+			if (error) break;
+			if (it->is_regular_file() && IsRomFile(it->path())) paths.push_back(it->path());
+		}
+	}
+	// same directories always give the same index
+	std::sort(paths.begin(), paths.end());
+
+	std::vector<uint8_t> table;
+	std::vector<uint8_t> snapshots;
+	std::unordered_set<uint64_t> seen;
+	uint32_t count = 0;
+
+	for (const auto& path : paths) {
+		std::ifstream rom(path, std::ios::binary);
+		std::vector<uint8_t> data((std::istreambuf_iterator<char>(rom)), std::istreambuf_iterator<char>());
+		if (data.empty()) continue;
+
+		Entry entry;
+		entry.hash = HashRom(data);
+		if (!seen.insert(entry.hash).second) continue; // same ROM under another name
+
+		entry.size = static_cast<uint32_t>(data.size());
+		entry.name = path.stem().string();
+		entry.path = path.string();
+		Detect(data, entry);
+
+		// this core only runs plain CHIP-8, anything else would boot into garbage
+		if (entry.platform == PLATFORM_CHIP8 && data.size() <= Chip8::MAX_ROM_SIZE) {
+			// fixed RNG seed and no keys, so the same ROM always gives the same snapshot
+			Chip8 chip8;
+			chip8.trace = nullptr; // the opcode log would bury the scan output
+			chip8.LoadROM(data);
+			// stop right before the first frame that draws or reads the keypad, so launching
+			// from the snapshot looks and plays exactly like loading the ROM, minus the setup
+			for (uint32_t frame = 0; frame < bootFrames; frame++) {
+				Chip8 next = chip8;
+				next.RunFrame();
+				if (next.drawFlag || next.keyPolled) break;
+				chip8 = next;
+			}
+
+			std::vector<uint8_t> snapshot = chip8.SaveState();
+			entry.snapshotOffset = snapshots.size(); // relative to the blob until we know the table size
+			entry.snapshotSize = static_cast<uint32_t>(snapshot.size());
+			snapshots.insert(snapshots.end(), snapshot.begin(), snapshot.end());
+		}
+
+		ByteIO::Put(table, entry.hash, 8);
+		ByteIO::Put(table, entry.size, 4);
+		ByteIO::Put(table, entry.platform, 1);
+		ByteIO::Put(table, entry.quirks, 1);
+		ByteIO::Put(table, entry.instructionsPerFrame, 2);
+		ByteIO::Put(table, entry.snapshotOffset, 8);
+		ByteIO::Put(table, entry.snapshotSize, 4);
+		PutString(table, entry.name);
+		PutString(table, entry.path);
+		count++;
+	}
+
+	std::vector<uint8_t> header(INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC));
+	ByteIO::Put(header, VERSION, 1);
+	ByteIO::Put(header, count, 4);
+	ByteIO::Put(header, table.size(), 4);
+
+	std::ofstream out(indexFile, std::ios::binary | std::ios::trunc);
+	if (!out) {
+		std::cerr << "Failed to write ROM index: " << indexFile << "\n";
+		return false;
+	}
+	out.write(reinterpret_cast<const char*>(header.data()), header.size());
+	out.write(reinterpret_cast<const char*>(table.data()), table.size());
+	out.write(reinterpret_cast<const char*>(snapshots.data()), snapshots.size());
+
+	std::cout << "Indexed " << count << " ROMs into " << indexFile << "\n";
+	return static_cast<bool>(out);
+}
+
+bool RomLibrary::Open(const std::string& indexFile)
+{
+	file.close();
+	file.open(indexFile, std::ios::binary);
+	if (!file) {
+		std::cerr << "Failed to open ROM index: " << indexFile << "\n";
+		return false;
+	}
+
+	std::vector<uint8_t> header(HEADER_SIZE);
+	file.read(reinterpret_cast<char*>(header.data()), header.size());
+	if (!file || !std::equal(INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC), header.begin()) || header[5] != VERSION) {
+		std::cerr << "Not a ROM index: " << indexFile << "\n";
+		return false;
+	}
+
+	size_t pos = 6;
+	uint64_t count, tableSize;
+	ByteIO::Read(header, pos, count, 4);
+	ByteIO::Read(header, pos, tableSize, 4);
+	// every entry takes at least MIN_ENTRY_SIZE bytes, don't let a bad count size the reserve
+	if (count * MIN_ENTRY_SIZE > tableSize) {
+		std::cerr << "Corrupt ROM index: " << indexFile << "\n";
+		return false;
+	}
+
+	// the whole table is read in one go, snapshots stay on disk until launched
+	std::vector<uint8_t> table(static_cast<size_t>(tableSize));
+	file.read(reinterpret_cast<char*>(table.data()), table.size());
+	if (!file) {
+		std::cerr << "Truncated ROM index: " << indexFile << "\n";
+		return false;
+	}
+
+	entries.clear();
+	byName.clear();
+	byHash.clear();
+	entries.reserve(static_cast<size_t>(count));
+
+	pos = 0;
+	for (uint64_t i = 0; i < count; i++) {
+		Entry entry;
+		uint64_t hash, size, platform, quirks, ipf, offset, snapshotSize;
+		if (!ByteIO::Read(table, pos, hash, 8) || !ByteIO::Read(table, pos, size, 4) || !ByteIO::Read(table, pos, platform, 1)
+			|| !ByteIO::Read(table, pos, quirks, 1) || !ByteIO::Read(table, pos, ipf, 2) || !ByteIO::Read(table, pos, offset, 8)
+			|| !ByteIO::Read(table, pos, snapshotSize, 4) || !GetString(table, pos, entry.name) || !GetString(table, pos, entry.path)) {
+			std::cerr << "Corrupt ROM index: " << indexFile << "\n";
+			return false;
+		}
+		entry.hash = hash;
+		entry.size = static_cast<uint32_t>(size);
+		entry.platform = static_cast<Platform>(platform);
+		entry.quirks = static_cast<uint8_t>(quirks);
+		entry.instructionsPerFrame = static_cast<uint16_t>(ipf);
+		entry.snapshotOffset = HEADER_SIZE + tableSize + offset;
+		entry.snapshotSize = static_cast<uint32_t>(snapshotSize);
+
+		byName.emplace(entry.name, entries.size()); // first one wins if two directories share a name
+		byHash.emplace(entry.hash, entries.size());
+		entries.push_back(std::move(entry));
+	}
+	return true;
+}
+
+const RomLibrary::Entry* RomLibrary::Find(const std::string& nameOrHash) const
+{
+	auto name = byName.find(nameOrHash);
+	if (name != byName.end()) return &entries[name->second];
+
+	if (nameOrHash.size() == 16 && std::all_of(nameOrHash.begin(), nameOrHash.end(), [](char c) { return isxdigit((unsigned char)c) != 0; })) {
+		auto hash = byHash.find(std::stoull(nameOrHash, nullptr, 16));
+		if (hash != byHash.end()) return &entries[hash->second];
+	}
+	return nullptr;
+}
+
+bool RomLibrary::Launch(const std::string& nameOrHash, Chip8& chip8)
+{
+	const Entry* entry = Find(nameOrHash);
+	if (!entry) {
+		std::cerr << "ROM not in library: " << nameOrHash << "\n";
+		return false;
+	}
+	if (entry->snapshotSize == 0) {
+		if (entry->platform != PLATFORM_CHIP8) std::cerr << "ROM needs SUPER-CHIP or XO-CHIP, which this core doesn't run: " << entry->name << "\n";
+		else std::cerr << "ROM too big to fit in memory: " << entry->name << " (" << entry->size << " bytes)\n";
+		return false;
+	}
+
+	std::vector<uint8_t> snapshot(entry->snapshotSize);
+	file.clear();
+	file.seekg(static_cast<std::streamoff>(entry->snapshotOffset));
+	file.read(reinterpret_cast<char*>(snapshot.data()), snapshot.size());
+	if (!file || !chip8.LoadState(snapshot)) {
+		std::cerr << "Corrupt snapshot for " << entry->name << "\n";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "Chip8.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Catalog of ROMs scanned once into an on-disk index. Every entry carries the
+// metadata a frontend needs plus a post-boot Chip8 snapshot, so launching a ROM
+// is a hash map lookup and one small read instead of loading and booting it.
+class RomLibrary
+{
+public:
+	enum Platform : uint8_t { PLATFORM_CHIP8, PLATFORM_SCHIP, PLATFORM_XOCHIP };
+
+	// interpreter behaviours the ROM most likely expects, for frontends that support them
+	enum Quirks : uint8_t {
+		QUIRK_VF_RESET = 0x01,         // 8xy1/8xy2/8xy3 clear VF
+		QUIRK_MEMORY_INCREMENT = 0x02, // Fx55/Fx65 leave I past the last register
+		QUIRK_DISPLAY_WAIT = 0x04,     // DXYN waits for vblank
+		QUIRK_CLIPPING = 0x08,         // sprites clip at the screen edge instead of wrapping
+		QUIRK_SHIFT_VX = 0x10,         // 8xy6/8xyE shift Vx and ignore Vy
+		QUIRK_JUMP_VX = 0x20,          // Bxnn jumps to xnn + Vx
+	};
+
+	struct Entry {
+		uint64_t hash = 0;
+		uint32_t size = 0;
+		Platform platform = PLATFORM_CHIP8;
+		uint8_t quirks = 0;
+		uint16_t instructionsPerFrame = 0;
+		std::string name; // file name without extension
+		std::string path;
+		uint64_t snapshotOffset = 0;
+		uint32_t snapshotSize = 0; // 0 when the ROM isn't plain CHIP-8 or doesn't fit in memory
+	};
+
+	// one second at 60 Hz, a ROM still setting up after that is probably stuck
+	static const uint32_t DEFAULT_BOOT_FRAMES = 60;
+
+	// Scans the directories (recursively) and writes a fresh index. Each snapshot
+	// is taken right before the first VIP timed frame that draws or reads the
+	// keypad, running at most bootFrames frames with no keys pressed.
+	static bool Build(const std::string& indexFile, const std::vector<std::string>& directories,
+		uint32_t bootFrames = DEFAULT_BOOT_FRAMES);
+
+	bool Open(const std::string& indexFile);
+	const std::vector<Entry>& Entries() const { return entries; }
+
+	// name is the file name without extension, hash the 16 digit hex content hash
+	const Entry* Find(const std::string& nameOrHash) const;
+	bool Launch(const std::string& nameOrHash, Chip8& chip8);
+
+	static uint64_t HashRom(const std::vector<uint8_t>& rom);
+
+private:
+	std::ifstream file; // kept open so launching only has to seek and read the snapshot
+	std::vector<Entry> entries;
+	std::unordered_map<std::string, size_t> byName;
+	std::unordered_map<uint64_t, size_t> byHash;
+
+	static void Detect(const std::vector<uint8_t>& rom, Entry& entry);
+};
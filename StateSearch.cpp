@@ -0,0 +1,313 @@
+#include "StateSearch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+namespace {
+
+// rough footprint of one unordered_set<uint64_t> entry (node + bucket)
+const size_t BYTES_PER_VISITED = 40;
+const size_t VISITED_SHARDS = 64;
+
+uint64_t Mix(uint64_t h, uint64_t v)
+{
+	h ^= v;
+	h *= 0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> 32);
+}
+
+uint64_t MixBytes(uint64_t h, const uint8_t* data, size_t length)
+{
+	// everything we hash is a multiple of 8 bytes
+	for (size_t i = 0; i < length; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		h = Mix(h, word);
+	}
+	return h;
+}
+
+// Set of state hashes split into shards so workers rarely wait on each other.
+// Each shard keeps two generations, when the current one fills up the older
+// one is thrown away, which keeps memory under the cap and evicts the states
+// seen longest ago first.
+class VisitedTable
+{
+public:
+	explicit VisitedTable(size_t memoryCap)
+		: shards(new Shard[VISITED_SHARDS])
+	{
+		shardCapacity = std::max<size_t>(1, memoryCap / BYTES_PER_VISITED / VISITED_SHARDS / 2);
+	}
+
+	// true if the hash wasn't seen before
+	bool Insert(uint64_t hash)
+	{
+		Shard& shard = shards[(hash >> 58) % VISITED_SHARDS];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+
+		if (shard.previous.count(hash)) return false;
+		if (!shard.current.insert(hash).second) return false;
+
+		if (shard.current.size() >= shardCapacity) {
+			shard.previous.swap(shard.current);
+			shard.current.clear();
+		}
+		return true;
+	}
+
+private:
+	struct Shard {
+		std::mutex mutex;
+		std::unordered_set<uint64_t> current;
+		std::unordered_set<uint64_t> previous;
+	};
+	std::unique_ptr<Shard[]> shards;
+	size_t shardCapacity;
+};
+
+// Fixed set of threads that all run the same job once per RunAll call,
+// reused for every frame of the search instead of spawning threads per level.
+class WorkerPool
+{
+public:
+	explicit WorkerPool(size_t count)
+	{
+		for (size_t i = 0; i < count; i++) {
+			workers.emplace_back([this, i]() { WorkerLoop(i); });
+		}
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& worker : workers) worker.join();
+	}
+
+	size_t Size() const { return workers.size(); }
+
+	void RunAll(const std::function<void(size_t)>& task)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		job = &task;
+		pending = workers.size();
+		++generation;
+		wake.notify_all();
+		done.wait(lock, [this]() { return pending == 0; });
+		job = nullptr;
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(size_t)>* job = nullptr;
+	uint64_t generation = 0;
+	size_t pending = 0;
+	bool stopping = false;
+
+	void WorkerLoop(size_t index)
+	{
+		uint64_t seen = 0;
+		while (true) {
+			const std::function<void(size_t)>* task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return stopping || generation != seen; });
+				if (stopping) return;
+				seen = generation;
+				task = job;
+			}
+
+			(*task)(index);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--pending == 0) done.notify_one();
+		}
+	}
+};
+
+// how a state was reached: index of its parent one frame earlier and the key held
+struct Trace {
+	uint32_t parent;
+	uint8_t key;
+};
+
+struct Node {
+	Chip8 state;
+	Trace trace;
+	uint32_t index; // into the history of its own depth
+	int64_t score;
+};
+
+std::vector<uint8_t> Backtrack(const std::vector<std::vector<Trace>>& history, size_t depth, uint32_t index)
+{
+	std::vector<uint8_t> inputs;
+	for (size_t level = depth + 1; level-- > 0;) {
+		const Trace& trace = history[level][index];
+		inputs.push_back(trace.key);
+		index = trace.parent;
+	}
+	std::reverse(inputs.begin(), inputs.end());
+	return inputs;
+}
+
+}
+
+StateSearch::StateSearch(const Options& options) : options(options)
+{
+}
+
+uint64_t StateSearch::HashState(const Chip8& chip8)
+{
+	uint64_t h = 0xCBF29CE484222325ULL;
+	h = MixBytes(h, chip8.V, sizeof(chip8.V));
+	// slots above sp are stale return addresses, they don't change the future
+	for (uint8_t i = 0; i < chip8.sp && i < 16; i++) h = Mix(h, chip8.stack[i]);
+	h = Mix(h, (uint64_t)chip8.I | ((uint64_t)chip8.pc << 16) | ((uint64_t)chip8.sp << 32)
+		| ((uint64_t)chip8.delayTimer << 40) | ((uint64_t)chip8.soundTimer << 48));
+	// a draw's overrun decides how many instructions the next frame gets
+	h = Mix(h, (uint32_t)chip8.cycleBudget);
+	// same machine with a different RNG state rolls different CXKK results
+	h = Mix(h, chip8.rng);
+
+	// pages that were never written still hold the same ROM in every branch
+	h = Mix(h, chip8.dirtyPages);
+	for (uint64_t pages = chip8.dirtyPages; pages; pages &= pages - 1) {
+		int page = 0;
+		while (!((pages >> page) & 1)) page++;
+		h = MixBytes(h, chip8.memory + page * 64, 64);
+	}
+
+	return MixBytes(h, chip8.display, sizeof(chip8.display));
+}
+
+StateSearch::Result StateSearch::Run(const Chip8& start, const Goal& goal, const Score& score)
+{
+	size_t threadCount = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+	WorkerPool pool(threadCount);
+	VisitedTable visited(options.memoryCap);
+
+	Result result;
+	std::vector<Node> frontier(1, Node{ start, Trace{ 0, 0 }, 0, 0 });
+	// snapshots never report to the caller's debugger, and the trace would
+	// both serialise the workers on one stream and race on its flags
+	frontier[0].state.debugger = nullptr;
+	frontier[0].state.trace = nullptr;
+	visited.Insert(HashState(frontier[0].state));
+	if (score) frontier[0].score = score(frontier[0].state);
+
+	result.state = frontier[0].state;
+	result.score = frontier[0].score;
+	if (goal && goal(frontier[0].state)) {
+		result.goalReached = true;
+		return result;
+	}
+
+	std::vector<std::vector<Trace>> history;
+	std::vector<std::vector<Node>> outputs(pool.Size());
+	std::atomic<uint64_t> expanded(0);
+	std::atomic<uint64_t> duplicates(0);
+	std::atomic<uint64_t> dropped(0);
+	// every kept child is a whole Chip8, BFS would otherwise grow 16x per frame without bound
+	const size_t maxChildren = std::max<size_t>(1, options.frontierCap / sizeof(Node));
+
+	for (uint32_t depth = 0; depth < options.maxDepth && !frontier.empty(); depth++) {
+		std::atomic<size_t> next(0);
+		std::atomic<size_t> kept(0);
+		std::mutex goalMutex;
+		std::atomic<size_t> goalParent(SIZE_MAX);
+		Node goalNode{ Chip8(), Trace{ 0, 0 }, 0, 0 };
+
+		pool.RunAll([&](size_t worker) {
+			std::vector<Node>& out = outputs[worker];
+			out.clear();
+
+			for (size_t i = next++; i < frontier.size(); i = next++) {
+				// parents are handed out in order, anything after a goal can't beat it
+				if (i > goalParent) break;
+				const Node& parent = frontier[i];
+
+				for (uint8_t key = 0; key < 16; key++) {
+					Node child{ parent.state, Trace{ parent.index, key }, 0, 0 };
+					child.state.SetKey(key, true);
+					child.state.RunFrame();
+					child.state.SetKey(key, false);
+					++expanded;
+
+					if (!visited.Insert(HashState(child.state))) {
+						++duplicates;
+						continue;
+					}
+
+					if (goal && goal(child.state)) {
+						std::lock_guard<std::mutex> lock(goalMutex);
+						if (i < goalParent || (i == goalParent && key < goalNode.trace.key)) {
+							goalParent = i;
+							goalNode = child;
+						}
+						break;
+					}
+
+					if (kept++ >= maxChildren) {
+						++dropped;
+						continue;
+					}
+					if (score) child.score = score(child.state);
+					out.push_back(std::move(child));
+				}
+			}
+		});
+
+		if (goalParent != SIZE_MAX) {
+			result.goalReached = true;
+			result.inputs = depth ? Backtrack(history, depth - 1, goalNode.trace.parent) : std::vector<uint8_t>();
+			result.inputs.push_back(goalNode.trace.key);
+			result.state = goalNode.state;
+			result.score = score ? score(goalNode.state) : 0;
+			break;
+		}
+
+		frontier.clear();
+		for (auto& out : outputs) {
+			for (auto& node : out) frontier.push_back(std::move(node));
+			out.clear();
+		}
+		if (frontier.empty()) break;
+
+		if (options.mode == BEAM && frontier.size() > options.beamWidth) {
+			std::nth_element(frontier.begin(), frontier.begin() + options.beamWidth, frontier.end(),
+				[](const Node& a, const Node& b) { return a.score > b.score; });
+			frontier.resize(options.beamWidth);
+		}
+
+		history.emplace_back();
+		history.back().reserve(frontier.size());
+		size_t best = 0;
+		for (size_t i = 0; i < frontier.size(); i++) {
+			frontier[i].index = static_cast<uint32_t>(i);
+			history.back().push_back(frontier[i].trace);
+			if (frontier[i].score > frontier[best].score) best = i;
+		}
+
+		result.inputs = Backtrack(history, depth, static_cast<uint32_t>(best));
+		result.state = frontier[best].state;
+		result.score = frontier[best].score;
+	}
+
+	result.expanded = expanded;
+	result.duplicates = duplicates;
+	result.dropped = dropped;
+	return result;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "Chip8.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Explores keypad input sequences from an in-memory Chip8 snapshot.
+// Every frame branches on all 16 keys, branches run across a worker pool and
+// states already seen (by hash) are dropped, so replaying from LoadROM isn't needed.
+class StateSearch
+{
+public:
+	enum Mode { BFS, BEAM };
+
+	struct Options {
+		Mode mode = BFS;
+		uint32_t maxDepth = 30;      // frames
+		size_t beamWidth = 1024;     // BEAM only, best states kept per frame
+		size_t threads = 0;          // 0 uses hardware_concurrency
+		size_t memoryCap = 64 << 20; // bytes for the visited table before old entries are evicted
+		size_t frontierCap = 256 << 20; // bytes of Chip8 states kept for the next frame, new states past it are dropped
+	};
+
+	using Goal = std::function<bool(const Chip8&)>;
+	using Score = std::function<int64_t(const Chip8&)>;
+
+	struct Result {
+		bool goalReached = false;
+		std::vector<uint8_t> inputs; // key held for each frame from the start state
+		Chip8 state;
+		int64_t score = 0;
+		uint64_t expanded = 0;
+		uint64_t duplicates = 0;
+		uint64_t dropped = 0; // new states thrown away by frontierCap (still tested against the goal)
+	};
+
+	explicit StateSearch(const Options& options);
+
+	// Stops at the first state that satisfies goal, otherwise returns the best
+	// scoring state seen at the deepest frame. Either callback may be empty.
+	// goal and score are called concurrently from every worker thread, so they
+	// must be safe to run at the same time (read only the Chip8 they're given).
+	// Snapshots run with the core's trace turned off.
+	Result Run(const Chip8& start, const Goal& goal, const Score& score);
+
+	// fast hash over registers, live stack, timers, frame cycle budget,
+	// written memory pages and the display
+	static uint64_t HashState(const Chip8& chip8);
+
+private:
+	Options options;
+};
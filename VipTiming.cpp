@@ -0,0 +1,74 @@
+#include "VipTiming.h"
+
+namespace {
+
+// per row cost of a DXYN sprite, plus the extras that depend on where it lands
+const uint16_t DRAW_BASE = 26;
+const uint16_t DRAW_ROW = 14;
+const uint16_t DRAW_ROW_SHIFTED = 10;
+const uint16_t DRAW_ROW_WRAPPED = 4;
+
+uint16_t OpcodeCost(uint16_t opcode)
+{
+	uint8_t X = (opcode & 0x0F00) >> 8;
+	uint8_t N = opcode & 0x000F;
+
+	switch (opcode & 0xF000) {
+	case 0x0000:
+		return opcode == 0x00E0 ? 24 : 23;
+	case 0x1000: return 23;
+	case 0x2000: return 26;
+	case 0x3000: return 12;
+	case 0x4000: return 12;
+	case 0x5000: return 16;
+	case 0x6000: return 6;
+	case 0x7000: return 10;
+	case 0x8000: return 44;
+	case 0x9000: return 16;
+	case 0xA000: return 12;
+	case 0xB000: return 23;
+	case 0xC000: return 36;
+	case 0xD000: return DRAW_BASE + N * DRAW_ROW;
+	case 0xE000: return 16;
+	case 0xF000:
+		switch (opcode & 0x00FF) {
+		case 0x0007: return 10;
+		case 0x000A: return 10; // the wait itself is handled by the interpreter loop
+		case 0x0015: return 10;
+		case 0x0018: return 10;
+		case 0x001E: return 19;
+		case 0x0029: return 20;
+		case 0x0033: return 204;
+		case 0x0055:
+		case 0x0065: return 14 + 14 * (X + 1);
+		}
+		return 10;
+	}
+	return 10;
+}
+
+}
+
+const std::array<uint16_t, 0x10000> VipTiming::table = VipTiming::BuildTable();
+
+std::array<uint16_t, 0x10000> VipTiming::BuildTable()
+{
+	std::array<uint16_t, 0x10000> costs{};
+	for (uint32_t opcode = 0; opcode < 0x10000; opcode++) {
+		costs[opcode] = OpcodeCost(static_cast<uint16_t>(opcode));
+	}
+	return costs;
+}
+
+uint16_t VipTiming::DrawCost(uint16_t opcode, uint8_t x, uint8_t y)
+{
+	uint8_t N = opcode & 0x000F;
+	uint16_t xPos = x % 64;
+	uint16_t yPos = y % 32;
+
+	uint16_t cost = table[opcode];
+	if (xPos & 0x7) cost += N * DRAW_ROW_SHIFTED;
+	if (xPos > 56) cost += N * DRAW_ROW_WRAPPED; // every row crosses the right edge
+	if (yPos + N > 32) cost += (yPos + N - 32) * DRAW_ROW_WRAPPED;
+	return cost;
+}
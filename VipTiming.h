@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <array>
+
+// Instruction costs of the original COSMAC VIP interpreter, in machine cycles
+// (8 clocks of the 1.7609 MHz CDP1802). The table is built once for every
+// possible opcode so the scheduler only does an array lookup per instruction,
+// register-count dependent costs like FX55/FX65 are folded straight into it.
+class VipTiming
+{
+public:
+	// 1760900 Hz / 8 clocks per machine cycle / 60 Hz
+	static const int32_t CYCLES_PER_FRAME = 3668;
+
+	static uint16_t Cost(uint16_t opcode) { return table[opcode]; }
+
+	// DXYN on top of its table cost: sprites that don't start on a byte boundary
+	// get shifted across two bytes per row, rows that wrap need their address recomputed
+	static uint16_t DrawCost(uint16_t opcode, uint8_t x, uint8_t y);
+
+private:
+	static const std::array<uint16_t, 0x10000> table;
+	static std::array<uint16_t, 0x10000> BuildTable();
+};
@@ -2,7 +2,14 @@
 //
 #include <SDL2/SDL.h>
 #include "Chip8.h"
+#include "Debugger.h"
+#include "FrameCapture.h"
+#include "RomLibrary.h"
 #include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
 #include <chrono>
 #include <thread>
 
@@ -20,11 +27,82 @@ SDL_Renderer* gRenderer = NULL;
 bool init();
 void close();
 bool PointerCheck(void* SDL_Object);
+bool ParseFrameNumber(const char* arg, uint32_t& value);
 
 int main(int argc, char* argv[])
 {
     Chip8 chip8;
-    chip8.LoadROM("particle_demo.ch8"); // load your own ROM here
+    std::string rom = "particle_demo.ch8"; // load your own ROM here, or pass --rom
+    std::string libraryFile;
+
+    bool debug = false;
+    bool vipTiming = false;
+    std::string recordFile;
+    std::string buildIndex;
+    std::vector<std::string> buildDirectories;
+    uint32_t bootFrames = RomLibrary::DEFAULT_BOOT_FRAMES;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--debug") debug = true;
+        else if (arg == "--vip-timing") vipTiming = true;
+        else if (arg == "--record" && i + 1 < argc) recordFile = argv[++i];
+        else if (arg == "--rom" && i + 1 < argc) rom = argv[++i];
+        else if (arg == "--library" && i + 1 < argc) libraryFile = argv[++i];
+        else if (arg == "--boot-frames" && i + 1 < argc) {
+            if (!ParseFrameNumber(argv[++i], bootFrames)) {
+                std::cerr << "usage: --boot-frames <frames>\n";
+                return 1;
+            }
+        }
+        else if (arg == "--build-library" && i + 1 < argc) {
+            // --build-library <index> <directory> [directory...], directories run up to the next option
+            buildIndex = argv[++i];
+            while (i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0) buildDirectories.push_back(argv[++i]);
+            if (buildDirectories.empty()) {
+                std::cerr << "usage: --build-library <index> <directory> [directory...] [--boot-frames <frames>]\n";
+                return 1;
+            }
+        }
+        else if (arg == "--export" && i + 2 < argc) {
+            // --export <capture> <out.ppm|out.y4m> [first frame] [frame count]
+            CaptureReader reader;
+            if (!reader.Open(argv[i + 1])) return 1;
+            std::string output = argv[i + 2];
+            uint32_t first = 0;
+            uint32_t count = reader.FrameCount();
+            if ((i + 3 < argc && !ParseFrameNumber(argv[i + 3], first)) || (i + 4 < argc && !ParseFrameNumber(argv[i + 4], count))) {
+                std::cerr << "usage: --export <capture> <out.ppm|out.y4m> [first frame] [frame count]\n";
+                return 1;
+            }
+            bool ppm = output.size() > 4 && output.compare(output.size() - 4, 4, ".ppm") == 0;
+            bool ok = ppm ? reader.WritePPM(output, first, PIXEL_WIDTH) : reader.WriteY4M(output, first, count, PIXEL_WIDTH);
+            return ok ? 0 : 1;
+        }
+    }
+
+    if (!buildIndex.empty()) return RomLibrary::Build(buildIndex, buildDirectories, bootFrames) ? 0 : 1;
+
+    // with a library --rom is a name or hash and the ROM comes out of the index's snapshot
+    if (!libraryFile.empty()) {
+        RomLibrary library;
+        if (!library.Open(libraryFile) || !library.Launch(rom, chip8)) return 1;
+    }
+    else {
+        chip8.LoadROM(rom);
+    }
+    // the core's RNG starts from a fixed seed so snapshots replay exactly, games want a new one each run
+    chip8.Seed(static_cast<uint32_t>(time(nullptr)));
+
+    // headless debugging, commands come from stdin so it can be scripted
+    if (debug) {
+        Debugger debugger(chip8);
+        debugger.SetVipTiming(vipTiming);
+        debugger.RunConsole(std::cin, std::cout);
+        return 0;
+    }
+
+    CaptureWriter capture;
+    if (!recordFile.empty() && !capture.Open(recordFile)) return 1;
 
     if (!init()) {
         printf("SDL INIT FAIL!");
@@ -32,11 +110,14 @@ int main(int argc, char* argv[])
     else {
         bool quit = false;
         SDL_Event e;
+        auto nextFrame = std::chrono::steady_clock::now();
+        auto nextCapture = nextFrame;
         while (quit == false) {
             while (SDL_PollEvent(&e) != 0) {
                 if (e.type == SDL_QUIT) quit = true;
             }
-            chip8.Cycle();
+            if (vipTiming) chip8.RunFrame();
+            else chip8.Cycle();
             if (chip8.drawFlag) {
                 SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 0xFF);
                 SDL_RenderClear(gRenderer);
@@ -57,9 +138,23 @@ int main(int argc, char* argv[])
                 }
                 chip8.drawFlag = false;
             }
+            if (vipTiming && !recordFile.empty()) capture.Push(chip8.display);
+            // Cycle() has no frames of its own, so sample the screen on a 60Hz clock like
+            // a real display would, the capture always plays back at 60 frames a second
+            while (!vipTiming && !recordFile.empty() && std::chrono::steady_clock::now() >= nextCapture) {
+                capture.Push(chip8.display);
+                nextCapture += std::chrono::microseconds(16667);
+            }
 
             SDL_RenderPresent(gRenderer);
-            std::this_thread::sleep_for(std::chrono::milliseconds(2)); // Roughly 500Hz (the clock of CHIP8)
+            if (vipTiming) {
+                // RunFrame already did a whole frame's worth of cycles, just pace it to 60Hz
+                nextFrame += std::chrono::microseconds(16667);
+                std::this_thread::sleep_until(nextFrame);
+            }
+            else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2)); // Roughly 500Hz (the clock of CHIP8)
+            }
         }
     }
 
@@ -112,3 +207,12 @@ bool PointerCheck(void* SDL_Object)
 
     return false;
 }
+
+bool ParseFrameNumber(const char* arg, uint32_t& value)
+{
+    char* end = nullptr;
+    unsigned long long parsed = strtoull(arg, &end, 10);
+    if (end == arg || *end != '\0' || *arg == '-' || parsed > UINT32_MAX) return false;
+    value = static_cast<uint32_t>(parsed);
+    return true;
+}